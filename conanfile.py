@@ -5,7 +5,6 @@ class LibrevaultConan(ConanFile):
     settings = "os", "compiler", "build_type", "arch"
     requires = [
         "docopt.cpp/0.6.3",
-        "sqlite3/3.36.0",
         "boost/1.77.0",
         "protobuf/3.17.1",
         "websocketpp/0.8.2",
@@ -14,7 +13,6 @@ class LibrevaultConan(ConanFile):
     ]
     generators = ["cmake_find_package", "cmake"]
     default_options = {
-        "sqlite3:threadsafe": 1,
         "qt:shared": True,
         "qt:qtsvg": True,
         "qt:qttranslations": True,
@@ -24,6 +24,13 @@ inline rust::Slice<const uint8_t> to_slice(const QByteArray& data) {
   return { reinterpret_cast<const uint8_t*>(data.data()), static_cast<size_t>(data.size())};
 }
 
+inline rust::Vec<uint8_t> to_vec(const QByteArray& data) {
+  rust::Vec<uint8_t> vec;
+  vec.reserve(data.size());
+  for (char byte : data) vec.push_back(static_cast<uint8_t>(byte));
+  return vec;
+}
+
 inline QByteArray from_vec(const rust::Vec<uint8_t>& data) {
   return {reinterpret_cast<const char*>(data.data()), static_cast<int>(data.size()) };
 }
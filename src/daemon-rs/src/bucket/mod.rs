@@ -38,7 +38,12 @@ impl Bucket {
         let system_dir = config.path.join(".librevault");
 
         tokio::fs::create_dir_all(&system_dir).await.unwrap();
-        let index = Arc::new(Index::new(system_dir.join("index.db").as_path()));
+        // Same as the defaults of the C++ daemon
+        let index = Arc::new(Index::new(
+            system_dir.join("index.db").as_path(),
+            "normal",
+            4,
+        ));
 
         Bucket {
             secret: config.secret,
@@ -0,0 +1,153 @@
+/* Copyright (C) 2016 Alexander Shishenko <alex@shishenko.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "IgnoreBenchmark.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QMutex>
+#include <QtDebug>
+
+#include "Secret.h"
+#include "control/FolderParams.h"
+#include "folder/DirectoryWalker.h"
+#include "folder/IgnoreList.h"
+#include "folder/IgnoreMatcher.h"
+#include "folder/PathNormalizer.h"
+
+namespace librevault {
+
+IgnoreBenchmark::IgnoreBenchmark(const QString& path, unsigned iterations, unsigned synthetic_patterns,
+                                 QObject* parent)
+    : QObject(parent), iterations_(qMax(iterations, 1u)), synthetic_patterns_(synthetic_patterns) {
+  QFile folders_defaults_f(":/config/folders.json");
+  folders_defaults_f.open(QIODevice::ReadOnly);
+  QVariantMap fconfig = QJsonDocument::fromJson(folders_defaults_f.readAll()).object().toVariantMap();
+
+  fconfig["path"] = path;
+  fconfig["secret"] = Secret().string();  // Nothing is encrypted, any secret will do
+  fconfig["system_path"] = system_dir_.path();
+  params_ = std::make_unique<FolderParams>(fconfig);
+
+  path_normalizer_ = new PathNormalizer(*params_, this);
+  ignore_list_ = new IgnoreList(*params_, *path_normalizer_, this);
+}
+
+IgnoreBenchmark::~IgnoreBenchmark() = default;
+
+QStringList IgnoreBenchmark::patterns() const {
+  QStringList patterns = ignore_list_->matcher()->patterns();
+
+  // Typical .lvignore contents: build directories, file extensions and files in nested directories, all with the helper
+  // directory pattern
+  for (unsigned i = 0; i < synthetic_patterns_; i++) {
+    QString pattern;
+    switch (i % 3) {
+      case 0: pattern = QStringLiteral("*.ext%1").arg(i); break;
+      case 1: pattern = QStringLiteral("build-%1").arg(i); break;
+      default: pattern = QStringLiteral("*/cache-%1/*.tmp").arg(i);
+    }
+    patterns << pattern << pattern + "/*";
+  }
+  return patterns;
+}
+
+int IgnoreBenchmark::separatorMismatches() const {
+  const QStringList patterns{
+      "*.log", "build/*", "*/node_modules/*", "a/*/c", "a?b", "[ab]*/x", "[^a]*", "?/?", "*/.git", "[a-c]/*",
+      "x.y", "a+b(c)", "[]x]", "[^]a]", "[unterminated", "dir\\*", "*\n*",
+  };
+  const QStringList paths{
+      "a.log", "x/a.log", "build", "build/", "build/x/y", "src/node_modules/p/q", "node_modules/p", "a/b/c", "a/b/d/c",
+      "a/b", "axb", "b/x", "bb/x", "c", "1/2", ".git", "z/.git", "x.y", "xzy", "a+b(c)", "]", "x", "a]", "dir\\x",
+      "a\nb", "A.LOG", "Build/X",
+  };
+
+  int mismatches = 0;
+  auto compare = [&](const QStringList& pattern_list) {
+    IgnoreMatcher matcher(pattern_list);
+    for (const QString& path : paths) {
+      if (matcher.match(path) == QDir::match(pattern_list, path)) continue;
+      qWarning() << "IgnoreMatcher differs from QDir::match for" << pattern_list << "on" << path;
+      mismatches++;
+    }
+  };
+  for (const QString& pattern : patterns) compare({pattern});
+  compare(patterns);
+  return mismatches;
+}
+
+QList<QString> IgnoreBenchmark::collectPaths() const {
+  QList<QString> paths;
+  QMutex paths_mtx;
+
+  DirectoryWalker walker(params_->scan_threads, false, false);
+  walker.walk(params_->path, [&, this](const DirectoryWalker::Entry& entry) {
+    QString normpath = QString::fromUtf8(path_normalizer_->normalizePath(entry.abspath));
+    QMutexLocker lk(&paths_mtx);
+    paths << normpath;
+    return DirectoryWalker::Action::DESCEND;
+  });
+  return paths;
+}
+
+QJsonObject IgnoreBenchmark::run() {
+  const QStringList patterns = this->patterns();
+  const QList<QString> paths = collectPaths();
+
+  QElapsedTimer timer;
+  timer.start();
+  IgnoreMatcher matcher(patterns);
+  qint64 compile_ns = timer.nsecsElapsed();
+
+  QVector<bool> baseline_results(paths.size());
+  timer.restart();
+  for (unsigned iteration = 0; iteration < iterations_; iteration++)
+    for (int i = 0; i < paths.size(); i++) baseline_results[i] = QDir::match(patterns, paths[i]);
+  qint64 baseline_ns = timer.nsecsElapsed();
+
+  QVector<bool> compiled_results(paths.size());
+  timer.restart();
+  for (unsigned iteration = 0; iteration < iterations_; iteration++)
+    for (int i = 0; i < paths.size(); i++) compiled_results[i] = matcher.match(paths[i]);
+  qint64 compiled_ns = timer.nsecsElapsed();
+
+  int ignored = 0, mismatches = 0;
+  for (int i = 0; i < paths.size(); i++) {
+    if (compiled_results[i]) ignored++;
+    if (compiled_results[i] != baseline_results[i]) mismatches++;
+  }
+
+  qreal matches = qreal(paths.size()) * iterations_;
+  auto per_match_ns = [&](qint64 ns) { return matches > 0 ? qreal(ns) / matches : 0; };
+
+  QJsonObject report;
+  report["path"] = params_->path;
+  report["patterns"] = patterns.size();
+  report["paths"] = paths.size();
+  report["iterations"] = (int)iterations_;
+  report["ignored"] = ignored;
+  report["mismatches"] = mismatches;
+  report["separator_mismatches"] = separatorMismatches();
+  report["compile_us"] = qreal(compile_ns) / 1e3;
+  report["qdir_match_ns"] = per_match_ns(baseline_ns);
+  report["compiled_ns"] = per_match_ns(compiled_ns);
+  report["speedup"] = compiled_ns > 0 ? qreal(baseline_ns) / qreal(compiled_ns) : 0;
+  return report;
+}
+
+}  // namespace librevault
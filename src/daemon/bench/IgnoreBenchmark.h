@@ -0,0 +1,53 @@
+/* Copyright (C) 2016 Alexander Shishenko <alex@shishenko.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <QJsonObject>
+#include <QObject>
+#include <QTemporaryDir>
+#include <memory>
+
+namespace librevault {
+
+struct FolderParams;
+class IgnoreList;
+class PathNormalizer;
+
+/* Matches every path of a directory against its ignore patterns, both with the compiled IgnoreMatcher and with
+ * QDir::match() over the raw pattern list, as IgnoreList did before. Results are also compared on a built-in set of
+ * patterns and paths with separators, where wildcard conversions tend to differ. Used by
+ * `librevault-daemon bench-ignore`. */
+class IgnoreBenchmark : public QObject {
+  Q_OBJECT
+ public:
+  IgnoreBenchmark(const QString& path, unsigned iterations, unsigned synthetic_patterns, QObject* parent);
+  ~IgnoreBenchmark() override;
+
+  QJsonObject run();
+
+ private:
+  QTemporaryDir system_dir_;
+  unsigned iterations_;
+  unsigned synthetic_patterns_;
+  std::unique_ptr<FolderParams> params_;
+  PathNormalizer* path_normalizer_;
+  IgnoreList* ignore_list_;
+
+  QStringList patterns() const;
+  QList<QString> collectPaths() const;
+  int separatorMismatches() const;
+};
+
+}  // namespace librevault
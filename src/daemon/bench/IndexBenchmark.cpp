@@ -0,0 +1,127 @@
+/* Copyright (C) 2016 Alexander Shishenko <alex@shishenko.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "IndexBenchmark.h"
+
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonDocument>
+#include <QThread>
+#include <QTimer>
+
+#include "control/FolderParams.h"
+#include "control/StateCollector.h"
+#include "folder/IgnoreList.h"
+#include "folder/PathNormalizer.h"
+#include "folder/meta/IndexerQueue.h"
+#include "folder/meta/MetaStorage.h"
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+namespace librevault {
+
+IndexBenchmark::IndexBenchmark(const QString& path, const QString& secret, unsigned threads,
+                               const QString& read_strategy, QObject* parent)
+    : QObject(parent), read_strategy_(read_strategy) {
+  QFile folders_defaults_f(":/config/folders.json");
+  folders_defaults_f.open(QIODevice::ReadOnly);
+  QVariantMap fconfig = QJsonDocument::fromJson(folders_defaults_f.readAll()).object().toVariantMap();
+
+  fconfig["path"] = path;
+  fconfig["secret"] = secret;
+  fconfig["system_path"] = system_dir_.path();
+  fconfig["index_event_timeout"] = 0;
+  fconfig["index_threads"] = threads;
+  fconfig["index_read_strategy"] = read_strategy;
+  params_ = std::make_unique<FolderParams>(fconfig);
+
+  state_collector_ = new StateCollector(this);
+  path_normalizer_ = new PathNormalizer(*params_, this);
+  ignore_list_ = new IgnoreList(*params_, *path_normalizer_, this);
+}
+
+IndexBenchmark::~IndexBenchmark() = default;
+
+QJsonObject IndexBenchmark::run() {
+  QEventLoop loop;
+  QElapsedTimer timer;
+  qint64 elapsed_ns = 0;
+  bool started = false;
+
+  // The timer includes the initial directory walk, as it is a part of the real rescan
+  timer.start();
+  auto meta_storage = std::make_unique<MetaStorage>(*params_, ignore_list_, path_normalizer_, state_collector_, nullptr);
+  IndexerQueue* indexer = meta_storage->indexer();
+
+  connect(indexer, &IndexerQueue::startedIndexing, &loop, [&] { started = true; });
+  connect(indexer, &IndexerQueue::finishedIndexing, &loop, [&] {
+    // Indexing is done, when the last batch is committed
+    meta_storage->flush();
+    elapsed_ns = timer.nsecsElapsed();
+    loop.quit();
+  });
+  // Runs after the initial rescan. If it found nothing, there is nothing to wait for.
+  QTimer::singleShot(0, &loop, [&] {
+    if (!started) {
+      elapsed_ns = timer.nsecsElapsed();
+      loop.quit();
+    }
+  });
+  loop.exec();
+
+  const IndexerStats& stats = indexer->stats();
+  qreal elapsed_s = qreal(elapsed_ns) / 1e9;
+  auto to_s = [](quint64 ns) { return qreal(ns) / 1e9; };
+
+  QJsonObject report;
+  report["path"] = params_->path;
+  report["threads"] = params_->index_threads > 0 ? int(params_->index_threads) : QThread::idealThreadCount();
+  report["read_strategy"] = read_strategy_;
+  report["files"] = (double)stats.files_indexed;
+  report["files_skipped"] = (double)stats.files_skipped;
+  report["bytes"] = (double)stats.bytes_indexed;
+  report["elapsed_s"] = elapsed_s;
+  report["files_per_s"] = elapsed_s > 0 ? qreal(stats.files_indexed) / elapsed_s : 0;
+  report["mb_per_s"] = elapsed_s > 0 ? qreal(stats.bytes_indexed) / 1e6 / elapsed_s : 0;
+  report["stage_s"] = QJsonObject{
+      {"stat", to_s(stats.stat_ns)},
+      {"chunking", to_s(stats.read_ns)},
+      {"encryption", to_s(stats.encryption_ns)},
+      {"hashing", to_s(stats.hashing_ns)},
+      {"index_put", to_s(stats.index_put_ns)},
+      {"index_flush", to_s(meta_storage->flushNs())},
+  };
+  report["memory"] = peakMemory();
+  return report;
+}
+
+QJsonObject IndexBenchmark::peakMemory() {
+  QJsonObject memory;
+#ifdef Q_OS_UNIX
+  struct rusage usage = {};
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef Q_OS_MAC
+    memory["peak_rss_bytes"] = (double)usage.ru_maxrss;
+#else
+    memory["peak_rss_bytes"] = (double)usage.ru_maxrss * 1024;
+#endif
+  }
+#endif
+  return memory;
+}
+
+}  // namespace librevault
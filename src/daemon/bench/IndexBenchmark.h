@@ -0,0 +1,52 @@
+/* Copyright (C) 2016 Alexander Shishenko <alex@shishenko.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <QJsonObject>
+#include <QObject>
+#include <QTemporaryDir>
+#include <memory>
+
+namespace librevault {
+
+struct FolderParams;
+class IgnoreList;
+class PathNormalizer;
+class StateCollector;
+
+/* Indexes a directory into a throwaway index, without networking, DHT and control server. Used by
+ * `librevault-daemon bench-index` to get reproducible indexing throughput numbers. */
+class IndexBenchmark : public QObject {
+  Q_OBJECT
+ public:
+  IndexBenchmark(const QString& path, const QString& secret, unsigned threads, const QString& read_strategy,
+                 QObject* parent);
+  ~IndexBenchmark() override;
+
+  /* Runs a nested event loop until every file is indexed. Returns the report. */
+  QJsonObject run();
+
+ private:
+  QTemporaryDir system_dir_;
+  QString read_strategy_;
+  std::unique_ptr<FolderParams> params_;
+  StateCollector* state_collector_;
+  PathNormalizer* path_normalizer_;
+  IgnoreList* ignore_list_;
+
+  static QJsonObject peakMemory();
+};
+
+}  // namespace librevault
@@ -0,0 +1,102 @@
+/* Copyright (C) 2016 Alexander Shishenko <alex@shishenko.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "RescanBenchmark.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QMutex>
+#include <QThread>
+#include <atomic>
+
+#include "Secret.h"
+#include "control/FolderParams.h"
+#include "folder/DirectoryWalker.h"
+#include "folder/IgnoreList.h"
+#include "folder/PathNormalizer.h"
+
+namespace librevault {
+
+RescanBenchmark::RescanBenchmark(const QString& path, unsigned threads, QObject* parent) : QObject(parent) {
+  QFile folders_defaults_f(":/config/folders.json");
+  folders_defaults_f.open(QIODevice::ReadOnly);
+  QVariantMap fconfig = QJsonDocument::fromJson(folders_defaults_f.readAll()).object().toVariantMap();
+
+  fconfig["path"] = path;
+  fconfig["secret"] = Secret().string();  // Nothing is encrypted, any secret will do
+  fconfig["system_path"] = system_dir_.path();
+  fconfig["scan_threads"] = threads;
+  params_ = std::make_unique<FolderParams>(fconfig);
+
+  path_normalizer_ = new PathNormalizer(*params_, this);
+  ignore_list_ = new IgnoreList(*params_, *path_normalizer_, this);
+}
+
+RescanBenchmark::~RescanBenchmark() = default;
+
+QJsonObject RescanBenchmark::rescan(PathNormalizer* path_normalizer, Mode mode) {
+  std::atomic<qint64> paths{0};
+  QMutex mtx;
+  QHash<QByteArray, FileStat> file_list;
+
+  QElapsedTimer timer;
+  timer.start();
+  DirectoryWalker walker(params_->scan_threads, !params_->preserve_symlinks);
+  walker.walkListings(params_->path, [&](const QString&, const QList<DirectoryWalker::Entry>& listing) {
+    QList<QByteArray> normpaths;
+    if (mode == Mode::BATCHED) {
+      QStringList abspaths;
+      for (const auto& entry : listing) abspaths << entry.abspath;
+      normpaths = path_normalizer->normalizePaths(abspaths);
+    } else {
+      for (const auto& entry : listing) normpaths << path_normalizer->normalizePath(entry.abspath);
+    }
+
+    QVector<DirectoryWalker::Action> actions(listing.size(), DirectoryWalker::Action::SKIP);
+    for (int i = 0; i < listing.size(); i++) {
+      if (ignore_list_->isIgnored(normpaths[i])) continue;
+      actions[i] = DirectoryWalker::Action::DESCEND;
+      QMutexLocker lk(&mtx);
+      file_list.insert(normpaths[i], listing[i].stat);
+    }
+    paths += listing.size();
+    return actions;
+  });
+  qint64 elapsed_ns = timer.nsecsElapsed();
+
+  QJsonObject report;
+  report["paths"] = (double)paths;
+  report["elapsed_s"] = qreal(elapsed_ns) / 1e9;
+  report["paths_per_s"] = elapsed_ns > 0 ? qreal(paths) * 1e9 / qreal(elapsed_ns) : 0;
+  return report;
+}
+
+QJsonObject RescanBenchmark::run() {
+  // Warms up the page cache and dentries, so the first measured pass is not penalized
+  rescan(path_normalizer_, Mode::BATCHED);
+
+  PathNormalizer cold_normalizer(*params_, nullptr);
+
+  QJsonObject report;
+  report["path"] = params_->path;
+  report["threads"] = params_->scan_threads > 0 ? int(params_->scan_threads) : QThread::idealThreadCount();
+  report["per_path_cold"] = rescan(&cold_normalizer, Mode::PER_PATH);
+  report["per_path_warm"] = rescan(&cold_normalizer, Mode::PER_PATH);
+  report["batched"] = rescan(path_normalizer_, Mode::BATCHED);
+  return report;
+}
+
+}  // namespace librevault
@@ -0,0 +1,49 @@
+/* Copyright (C) 2016 Alexander Shishenko <alex@shishenko.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <QJsonObject>
+#include <QObject>
+#include <QTemporaryDir>
+#include <memory>
+
+namespace librevault {
+
+struct FolderParams;
+class IgnoreList;
+class PathNormalizer;
+
+/* Walks a directory the way a full rescan does: stat, normalize and ignore check for every path. Path normalization is
+ * done per path with a cold cache, per path with a warm cache, and batched per directory listing. Used by
+ * `librevault-daemon bench-rescan`. */
+class RescanBenchmark : public QObject {
+  Q_OBJECT
+ public:
+  RescanBenchmark(const QString& path, unsigned threads, QObject* parent);
+  ~RescanBenchmark() override;
+
+  QJsonObject run();
+
+ private:
+  QTemporaryDir system_dir_;
+  std::unique_ptr<FolderParams> params_;
+  PathNormalizer* path_normalizer_;
+  IgnoreList* ignore_list_;
+
+  enum class Mode { PER_PATH, BATCHED };
+  QJsonObject rescan(PathNormalizer* path_normalizer, Mode mode);
+};
+
+}  // namespace librevault
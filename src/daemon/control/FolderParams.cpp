@@ -28,12 +28,26 @@ FolderParams::FolderParams(QVariantMap fconfig) {
   // Optional
   system_path = fconfig["system_path"].isValid() ? fconfig["system_path"].toString() : path + "/.librevault";
   index_event_timeout = std::chrono::milliseconds(fconfig["index_event_timeout"].toInt());
+
+  QString index_read_strategy_str = fconfig["index_read_strategy"].toString();
+  index_read_strategy = ReadStrategy::BUFFERED;
+  if (index_read_strategy_str == "large_buffer") index_read_strategy = ReadStrategy::LARGE_BUFFER;
+  if (index_read_strategy_str == "drop_cache") index_read_strategy = ReadStrategy::DROP_CACHE;
+  index_threads = fconfig["index_threads"].toUInt();
+  index_synchronous = fconfig["index_synchronous"].toString();
+  index_read_connections = fconfig["index_read_connections"].toUInt();
+  index_trusted_load = fconfig["index_trusted_load"].toBool();
+  index_verify_sample = fconfig["index_verify_sample"].toUInt();
+  scan_threads = fconfig["scan_threads"].toUInt();
+
   preserve_unix_attrib = fconfig["preserve_unix_attrib"].toBool();
   preserve_windows_attrib = fconfig["preserve_windows_attrib"].toBool();
   preserve_symlinks = fconfig["preserve_symlinks"].toBool();
   normalize_unicode = fconfig["normalize_unicode"].toBool();
   chunk_strong_hash_type = Meta::StrongHashType(fconfig["chunk_strong_hash_type"].toInt());
   full_rescan_interval = std::chrono::seconds(fconfig["full_rescan_interval"].toInt());
+  fast_rescan = fconfig["fast_rescan"].toBool();
+  deep_rescan_every = fconfig["deep_rescan_every"].toUInt();
 
   for (const QString& ignore_path : fconfig["ignore_paths"].toStringList()) ignore_paths.push_back(ignore_path);
   for (const QString& node : fconfig["nodes"].toStringList()) nodes.push_back(node);
@@ -27,6 +27,7 @@ namespace librevault {
 
 struct FolderParams {
   enum class ArchiveType : unsigned { NO_ARCHIVE = 0, TRASH_ARCHIVE, TIMESTAMP_ARCHIVE, BLOCK_ARCHIVE };
+  enum class ReadStrategy : unsigned { BUFFERED = 0, LARGE_BUFFER, DROP_CACHE };
 
   FolderParams(QVariantMap fconfig);
 
@@ -35,12 +36,21 @@ struct FolderParams {
   QString path;
   QString system_path;
   std::chrono::milliseconds index_event_timeout;
+  ReadStrategy index_read_strategy;
+  unsigned index_threads;  // 0 means QThread::idealThreadCount()
+  QString index_synchronous;  // SQLite synchronous level of the index: off, normal, full or extra
+  unsigned index_read_connections;
+  bool index_trusted_load;  // Opt-in. Metas, read from the index, are not verified, as they were verified on put
+  unsigned index_verify_sample;  // With index_trusted_load, every Nth Meta is verified anyway. 0 disables sampling.
+  unsigned scan_threads;   // 0 means QThread::idealThreadCount()
   bool preserve_unix_attrib;
   bool preserve_windows_attrib;
   bool preserve_symlinks;
   bool normalize_unicode;
   Meta::StrongHashType chunk_strong_hash_type;
   std::chrono::seconds full_rescan_interval;
+  bool fast_rescan;  // Periodic rescans skip directories with unchanged stat
+  unsigned deep_rescan_every;  // With fast_rescan, every Nth periodic rescan still reads everything
   QStringList ignore_paths;
   QList<QUrl> nodes;
   ArchiveType archive_type;
@@ -0,0 +1,332 @@
+/* Copyright (C) 2016 Alexander Shishenko <alex@shishenko.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "DirectoryWalker.h"
+
+#include <QDirIterator>
+#include <QFile>
+#include <QMutex>
+#include <QSet>
+#include <QThread>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+#endif
+
+namespace librevault {
+
+namespace {
+
+struct QueuedDir {
+  QString abspath;
+  bool cached = false;  // Listed with the cached listing callback
+};
+
+// Per-thread deque of directories. The owner takes from the back (depth-first, better locality), thieves take from
+// the front (the largest pieces of work).
+struct WorkQueue {
+  std::mutex mtx;
+  std::deque<QueuedDir> dirs;
+};
+
+#ifdef Q_OS_LINUX
+struct linux_dirent64 {
+  ino64_t d_ino;
+  off64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+Meta::Type typeFromMode(mode_t mode) {
+  if (S_ISREG(mode)) return Meta::FILE;
+  if (S_ISDIR(mode)) return Meta::DIRECTORY;
+  if (S_ISLNK(mode)) return Meta::SYMLINK;
+  return Meta::DELETED;
+}
+
+Meta::Type typeFromDirent(unsigned char d_type) {
+  switch (d_type) {
+    case DT_REG: return Meta::FILE;
+    case DT_DIR: return Meta::DIRECTORY;
+    case DT_LNK: return Meta::SYMLINK;
+    default: return Meta::DELETED;
+  }
+}
+
+FileStat statAt(int dir_fd, const char* name, bool follow_symlinks) {
+  FileStat stat;
+#ifdef STATX_BASIC_STATS
+  struct statx stx = {};
+  int flags = AT_STATX_DONT_SYNC | (follow_symlinks ? 0 : AT_SYMLINK_NOFOLLOW);
+  if (statx(dir_fd, name, flags, STATX_TYPE | STATX_MODE | STATX_INO | STATX_SIZE | STATX_MTIME | STATX_CTIME, &stx))
+    return stat;
+
+  stat.type = typeFromMode(stx.stx_mode);
+  stat.dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+  stat.inode = stx.stx_ino;
+  stat.size = stx.stx_size;
+  stat.mtime_ns = qint64(stx.stx_mtime.tv_sec) * 1000000000 + stx.stx_mtime.tv_nsec;
+  stat.ctime_ns = qint64(stx.stx_ctime.tv_sec) * 1000000000 + stx.stx_ctime.tv_nsec;
+#else
+  struct stat stat_buf = {};
+  if (fstatat(dir_fd, name, &stat_buf, follow_symlinks ? 0 : AT_SYMLINK_NOFOLLOW)) return stat;
+
+  stat.type = typeFromMode(stat_buf.st_mode);
+  stat.dev = stat_buf.st_dev;
+  stat.inode = stat_buf.st_ino;
+  stat.size = stat_buf.st_size;
+  stat.mtime_ns = qint64(stat_buf.st_mtim.tv_sec) * 1000000000 + stat_buf.st_mtim.tv_nsec;
+  stat.ctime_ns = qint64(stat_buf.st_ctim.tv_sec) * 1000000000 + stat_buf.st_ctim.tv_nsec;
+#endif
+  if (stat.type == Meta::DELETED) stat = FileStat();  // Sockets, devices and such
+  return stat;
+}
+#endif
+
+}  // namespace
+
+DirectoryWalker::DirectoryWalker(unsigned threads, bool follow_symlinks, bool with_stat)
+    : threads_(threads > 0 ? threads : std::max(1, QThread::idealThreadCount())),
+      follow_symlinks_(follow_symlinks),
+      with_stat_(with_stat) {}
+
+QList<DirectoryWalker::Subdir> DirectoryWalker::descendInto(const QString& dir, const QList<Entry>& listing,
+                                                           const ListingVisitor& visitor) {
+  QList<Subdir> subdirs;
+  QVector<Action> actions = visitor(dir, listing);
+  for (int i = 0; i < listing.size(); i++) {
+    if (listing[i].stat.type != Meta::DIRECTORY) continue;
+    Action action = actions.value(i, Action::SKIP);
+    if (action != Action::SKIP) subdirs.append({listing[i], action == Action::REUSE});
+  }
+  return subdirs;
+}
+
+QList<DirectoryWalker::Subdir> DirectoryWalker::listCached(const QString& dir, const ListingVisitor& visitor) {
+  QList<Entry> listing = cached_listing_(dir);
+  for (Entry& entry : listing)
+    if (entry.stat.type == Meta::DIRECTORY) entry.stat = FileStat::read(entry.abspath, follow_symlinks_);
+  return descendInto(dir, listing, visitor);
+}
+
+void DirectoryWalker::walk(const QString& root, const Visitor& visitor) {
+  walkListings(root, [&visitor](const QString&, const QList<Entry>& listing) {
+    QVector<Action> actions;
+    actions.reserve(listing.size());
+    for (const Entry& entry : listing) actions << visitor(entry);
+    return actions;
+  });
+}
+
+void DirectoryWalker::walkListings(const QString& root, const ListingVisitor& visitor) {
+  std::vector<WorkQueue> queues(threads_);
+  std::atomic<size_t> pending{1};  // Directories, queued or being listed
+  std::atomic<size_t> queued{1};   // Directories in the queues. Changed under the lock of the queue.
+  std::mutex idle_mtx;
+  std::condition_variable idle_cv;
+
+  // The first exception, thrown on a walker thread, stops the walk, and is rethrown on the calling thread
+  std::atomic<bool> aborted{false};
+  std::exception_ptr error;
+
+  // Symlinked directories can form cycles
+  QMutex visited_mtx;
+  QSet<QPair<quint64, quint64>> visited;
+
+  queues[0].dirs.push_back({QDir::cleanPath(root), false});
+  if (follow_symlinks_) {
+    FileStat root_stat = FileStat::read(queues[0].dirs.front().abspath, true);
+    visited.insert({root_stat.dev, root_stat.inode});
+  }
+
+  auto take = [&](unsigned self, QueuedDir& dir) {
+    {
+      std::lock_guard<std::mutex> lk(queues[self].mtx);
+      if (!queues[self].dirs.empty()) {
+        dir = std::move(queues[self].dirs.back());
+        queues[self].dirs.pop_back();
+        queued--;
+        return true;
+      }
+    }
+    for (unsigned i = 1; i < threads_; i++) {
+      WorkQueue& victim = queues[(self + i) % threads_];
+      std::lock_guard<std::mutex> lk(victim.mtx);
+      if (!victim.dirs.empty()) {
+        dir = std::move(victim.dirs.front());
+        victim.dirs.pop_front();
+        queued--;
+        return true;
+      }
+    }
+    return false;
+  };
+
+  // Waiters check the state under idle_mtx, so it is taken before notifying, or the wakeup could be missed
+  auto notify = [&](bool all) {
+    { std::lock_guard<std::mutex> lk(idle_mtx); }
+    if (all)
+      idle_cv.notify_all();
+    else
+      idle_cv.notify_one();
+  };
+
+  auto work = [&](unsigned self) {
+    while (!aborted) {
+      QueuedDir dir;
+      if (take(self, dir)) {
+        QList<Subdir> subdirs = dir.cached && cached_listing_ ? listCached(dir.abspath, visitor)
+                                                              : listDirectory(dir.abspath, visitor);
+
+        if (follow_symlinks_) {
+          QMutexLocker lk(&visited_mtx);
+          for (auto it = subdirs.begin(); it != subdirs.end();) {
+            QPair<quint64, quint64> id(it->entry.stat.dev, it->entry.stat.inode);
+            if (it->entry.stat.inode == 0)  // No inode numbers on this platform
+              ++it;
+            else if (visited.contains(id))
+              it = subdirs.erase(it);
+            else {
+              visited.insert(id);
+              ++it;
+            }
+          }
+        }
+
+        if (!subdirs.isEmpty()) {
+          pending += subdirs.size();
+          {
+            std::lock_guard<std::mutex> lk(queues[self].mtx);
+            for (Subdir& subdir : subdirs)
+              queues[self].dirs.push_back({std::move(subdir.entry.abspath), subdir.cached});
+            queued += subdirs.size();
+          }
+          for (int i = 0; i < subdirs.size() && i < int(threads_) - 1; i++) notify(false);
+        }
+
+        if (--pending == 0) {
+          notify(true);
+          return;
+        }
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lk(idle_mtx);
+      idle_cv.wait(lk, [&] { return pending == 0 || queued > 0 || aborted; });
+      if (pending == 0) return;
+    }
+  };
+
+  auto worker = [&](unsigned self) {
+    try {
+      work(self);
+    } catch (...) {
+      {
+        std::lock_guard<std::mutex> lk(idle_mtx);
+        if (!error) error = std::current_exception();
+        aborted = true;
+      }
+      idle_cv.notify_all();
+    }
+  };
+
+  // The calling thread is one of the workers
+  std::vector<std::thread> threads;
+  for (unsigned i = 1; i < threads_; i++) threads.emplace_back(worker, i);
+  worker(0);
+  for (auto& thread : threads) thread.join();
+
+  if (error) std::rethrow_exception(error);
+}
+
+#ifdef Q_OS_LINUX
+QList<DirectoryWalker::Subdir> DirectoryWalker::listDirectory(const QString& dir, const ListingVisitor& visitor) {
+  QList<Entry> listing;
+
+  int dir_fd = open(QFile::encodeName(dir).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd < 0) {
+    if (unreadable_handler_) unreadable_handler_(dir);
+    return {};
+  }
+
+  alignas(linux_dirent64) char buffer[64 * 1024];
+  for (;;) {
+    long len = syscall(SYS_getdents64, dir_fd, buffer, sizeof(buffer));
+    if (len < 0) {
+      // A partial listing would look like deleted entries
+      close(dir_fd);
+      if (unreadable_handler_) unreadable_handler_(dir);
+      return {};
+    }
+    if (len == 0) break;
+
+    for (long offset = 0; offset < len;) {
+      auto* dirent = reinterpret_cast<linux_dirent64*>(buffer + offset);
+      offset += dirent->d_reclen;
+
+      const char* name = dirent->d_name;
+      if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+      Entry entry;
+      entry.abspath = dir + QLatin1Char('/') + QFile::decodeName(name);
+      // Type from the directory entry is enough, unless it is unknown or a symlink, that must be followed. When
+      // following symlinks, directory inodes are needed to detect cycles.
+      if (with_stat_ || dirent->d_type == DT_UNKNOWN ||
+          (follow_symlinks_ && (dirent->d_type == DT_LNK || dirent->d_type == DT_DIR)))
+        entry.stat = statAt(dir_fd, name, follow_symlinks_);
+      else
+        entry.stat.type = typeFromDirent(dirent->d_type);
+
+      listing << entry;
+    }
+  }
+  close(dir_fd);
+
+  return descendInto(dir, listing, visitor);
+}
+#else
+QList<DirectoryWalker::Subdir> DirectoryWalker::listDirectory(const QString& dir, const ListingVisitor& visitor) {
+  QList<Entry> listing;
+
+  if (!QDir(dir).isReadable()) {
+    if (unreadable_handler_) unreadable_handler_(dir);
+    return {};
+  }
+
+  QDirIterator dir_it(dir, QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System);
+  while (dir_it.hasNext()) {
+    Entry entry;
+    entry.abspath = dir_it.next();
+    entry.stat = FileStat::read(entry.abspath, follow_symlinks_);
+
+    listing << entry;
+  }
+
+  return descendInto(dir, listing, visitor);
+}
+#endif
+
+}  // namespace librevault
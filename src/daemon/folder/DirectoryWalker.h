@@ -0,0 +1,84 @@
+/* Copyright (C) 2016 Alexander Shishenko <alex@shishenko.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <QList>
+#include <QString>
+#include <QVector>
+#include <functional>
+
+#include "folder/meta/FileStat.h"
+
+namespace librevault {
+
+/* Parallel recursive directory traversal. Directories are distributed among threads with work stealing, so one deep
+ * or slow subtree doesn't stall the others. On Linux, entries are read with getdents64 and statx directly. */
+class DirectoryWalker {
+ public:
+  enum class Action {
+    DESCEND,
+    SKIP,
+    REUSE,  // Descend, but take the listing from the cached listing callback instead of reading the directory
+  };
+
+  struct Entry {
+    QString abspath;
+    FileStat stat;  // Only type is filled in, unless the walker is created with_stat
+  };
+
+  /* Called concurrently from walker threads. The result is used for directories only: SKIP prunes the subtree. */
+  using Visitor = std::function<Action(const Entry& entry)>;
+  /* Same, but called once per directory with all of its entries, even if there are none. Returns an action for every
+   * entry. */
+  using ListingVisitor = std::function<QVector<Action>(const QString& dir, const QList<Entry>& listing)>;
+  /* Previously seen entries of a directory, which is known to be unchanged. Subdirectories in it are stat'ed again,
+   * as their own contents could still change. */
+  using CachedListing = std::function<QList<Entry>(const QString& dir)>;
+  /* Called concurrently for directories, that could not be read. The visitor is not called for them, as their
+   * contents are unknown rather than empty. */
+  using UnreadableHandler = std::function<void(const QString& dir)>;
+
+  /* threads == 0 means QThread::idealThreadCount() */
+  DirectoryWalker(unsigned threads, bool follow_symlinks, bool with_stat = true);
+
+  /* Visits everything below root, excluding root itself. Blocks until the whole tree is visited. An exception, thrown by
+   * the visitor, stops the walk and is rethrown here. */
+  void walk(const QString& root, const Visitor& visitor);
+  void walkListings(const QString& root, const ListingVisitor& visitor);
+
+  void setCachedListing(CachedListing cached_listing) { cached_listing_ = std::move(cached_listing); }
+  void setUnreadableHandler(UnreadableHandler unreadable_handler) {
+    unreadable_handler_ = std::move(unreadable_handler);
+  }
+
+ private:
+  unsigned threads_;
+  bool follow_symlinks_;
+  bool with_stat_;
+  CachedListing cached_listing_;
+  UnreadableHandler unreadable_handler_;
+
+  struct Subdir {
+    Entry entry;
+    bool cached = false;
+  };
+
+  // Lists one directory. Returns subdirectories, the visitor wants to descend into.
+  QList<Subdir> listDirectory(const QString& dir, const ListingVisitor& visitor);
+  QList<Subdir> listCached(const QString& dir, const ListingVisitor& visitor);
+  static QList<Subdir> descendInto(const QString& dir, const QList<Entry>& listing, const ListingVisitor& visitor);
+};
+
+}  // namespace librevault
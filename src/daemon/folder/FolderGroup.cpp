@@ -80,7 +80,8 @@ FolderGroup::FolderGroup(FolderParams params, StateCollector* state_collector, Q
 
   // Go through index
   QTimer::singleShot(0, this, [=] {
-    for (auto& smeta : meta_storage_->getMeta()) handleIndexedMeta(smeta);
+    meta_storage_->forEachMeta(MetaStorage::MetaFilter::ALL,
+                               [this](const SignedMeta& smeta) { handleIndexedMeta(smeta); });
   });
 }
 
@@ -15,10 +15,15 @@
  */
 #include "IgnoreList.h"
 
-#include <QDirIterator>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
 #include <QLoggingCategory>
+#include <QMutex>
+#include <QTextStream>
 
 #include "control/FolderParams.h"
+#include "folder/DirectoryWalker.h"
 #include "folder/PathNormalizer.h"
 
 Q_LOGGING_CATEGORY(log_ignorelist, "folder.ignorelist")
@@ -26,57 +31,104 @@ Q_LOGGING_CATEGORY(log_ignorelist, "folder.ignorelist")
 namespace librevault {
 
 IgnoreList::IgnoreList(const FolderParams& params, PathNormalizer& path_normalizer, QObject* parent)
-    : QObject(parent), params_(params), path_normalizer_(path_normalizer), last_rebuild_(QDateTime::fromMSecsSinceEpoch(0)) {
-  lazyRebuildIgnores();
+    : QObject(parent), params_(params), path_normalizer_(path_normalizer) {
+  discoverIgnoreFiles();
 }
 
 bool IgnoreList::isIgnored(QByteArray normpath) {
-  lazyRebuildIgnores();
+  return matcher()->match(QString::fromUtf8(normpath));
+}
+
+void IgnoreList::pathChanged(const QString& native_abspath) {
+  QString abspath = QDir::fromNativeSeparators(native_abspath);
+  if (!abspath.endsWith(QStringLiteral("/.lvignore"))) return;
+
+  QString prefix = ignorePrefix(abspath);
+  bool exists = QFileInfo(abspath).isFile();
+  QStringList patterns = exists ? parseIgnoreFile(abspath, prefix) : QStringList();
+  {
+    QMutexLocker lk(&ignore_files_mtx_);
+    auto it = ignore_files_.find(prefix);
+    if (exists) {
+      if (it != ignore_files_.end() && *it == patterns) return;  // Touched, but not changed
+      ignore_files_.insert(prefix, patterns);
+    } else {
+      if (it == ignore_files_.end()) return;
+      ignore_files_.erase(it);
+    }
+    compile();
+  }
 
-  QReadLocker lk(&ignorelist_mtx);
-  return QDir::match(filters_wildcard_, QString::fromUtf8(normpath));
+  qCDebug(log_ignorelist) << "Ignore file changed:" << abspath;
+  emit ignoresChanged(QDir::toNativeSeparators(QFileInfo(abspath).path()));
 }
 
-void IgnoreList::lazyRebuildIgnores() {
-  QWriteLocker lk(&ignorelist_mtx);
-  if (last_rebuild_.msecsTo(QDateTime::currentDateTimeUtc()) > 10 * 1000) {
-    rebuildIgnores();
-    last_rebuild_ = QDateTime::currentDateTimeUtc();
+void IgnoreList::discoverIgnoreFiles() {
+  qCDebug(log_ignorelist) << "Looking for ignore files";
+
+  // isIgnored() can't be used here, there are no patterns yet. Only the system folder is pruned.
+  const QString system_path = QDir::cleanPath(params_.path + "/.librevault");
+  QStringList ignorefile_paths;
+  QMutex ignorefile_paths_mtx;
+
+  DirectoryWalker walker(params_.scan_threads, false, false);
+  walker.walk(params_.path, [&](const DirectoryWalker::Entry& entry) {
+    if (entry.stat.type == Meta::DIRECTORY)
+      return entry.abspath == system_path ? DirectoryWalker::Action::SKIP : DirectoryWalker::Action::DESCEND;
+
+    if (entry.stat.type == Meta::FILE && entry.abspath.endsWith(QStringLiteral("/.lvignore"))) {
+      QMutexLocker paths_lk(&ignorefile_paths_mtx);
+      ignorefile_paths << entry.abspath;
+    }
+    return DirectoryWalker::Action::SKIP;
+  });
+
+  QMutexLocker lk(&ignore_files_mtx_);
+  ignore_files_.clear();
+  for (const QString& ignorefile_path : qAsConst(ignorefile_paths)) {
+    qCDebug(log_ignorelist) << "Found ignore file:" << ignorefile_path;
+    QString prefix = ignorePrefix(ignorefile_path);
+    ignore_files_.insert(prefix, parseIgnoreFile(ignorefile_path, prefix));
   }
+  compile();
+}
+
+QString IgnoreList::ignorePrefix(const QString& ignorefile_path) {
+  // Compute "root" for current ignore file
+  QString ignore_prefix = QString::fromUtf8(path_normalizer_.normalizePath(ignorefile_path));
+  ignore_prefix.chop(QStringLiteral(".lvignore").size());
+  return ignore_prefix;
+}
+
+QStringList IgnoreList::parseIgnoreFile(const QString& ignorefile_path, const QString& prefix) {
+  qCDebug(log_ignorelist) << "Ignore file prefix:" << (prefix.isEmpty() ? "(root)" : prefix);
+
+  QStringList patterns;
+  QFile ignorefile(ignorefile_path);
+  if (ignorefile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+    QTextStream stream(&ignorefile);
+    stream.setCodec("UTF-8");
+    while (!stream.atEnd()) {
+      parseLine(patterns, prefix, stream.readLine());
+    }
+  } else
+    qCWarning(log_ignorelist) << "Could not open ignore file:" << ignorefile_path;
+  return patterns;
 }
 
-void IgnoreList::rebuildIgnores() {
-  filters_wildcard_.clear();
+void IgnoreList::compile() {
+  QStringList patterns;
 
   // System folder
-  addIgnorePattern(".librevault");
+  addIgnorePattern(patterns, ".librevault");
 
-  QDirIterator dir_it(params_.path, QStringList() << ".lvignore", QDir::Files | QDir::Hidden | QDir::Readable,
-                      QDirIterator::Subdirectories);
-  qCDebug(log_ignorelist) << "Rebuilding ignore list";
-  while (dir_it.hasNext()) {
-    QString ignorefile_path = dir_it.next();
-    qCDebug(log_ignorelist) << "Found ignore file:" << ignorefile_path;
+  // Ordered by prefix, so the same set of ignore files always gives the same pattern list
+  for (const QStringList& file_patterns : qAsConst(ignore_files_)) patterns << file_patterns;
 
-    // Compute "root" for current ignore file
-    QString ignore_prefix = QString::fromUtf8(path_normalizer_.normalizePath(ignorefile_path));
-    ignore_prefix.chop(QStringLiteral(".lvignore").size());
-    qCDebug(log_ignorelist) << "Ignore file prefix:" << (ignore_prefix.isEmpty() ? "(root)" : ignore_prefix);
-
-    // Read ignore file
-    QFile ignorefile(ignorefile_path);
-    if (ignorefile.open(QIODevice::ReadOnly | QIODevice::Text)) {
-      QTextStream stream(&ignorefile);
-      stream.setCodec("UTF-8");
-      while (!stream.atEnd()) {
-        parseLine(ignore_prefix, stream.readLine());
-      }
-    } else
-      qCWarning(log_ignorelist) << "Could not open ignore file:" << ignorefile_path;
-  }
+  std::atomic_store(&matcher_, std::shared_ptr<const IgnoreMatcher>(std::make_shared<IgnoreMatcher>(patterns)));
 }
 
-void IgnoreList::parseLine(QString prefix, QString line) {
+void IgnoreList::parseLine(QStringList& patterns, QString prefix, QString line) {
   if (line.size() == 0) return;
   if (line.left(1) == "#") return;                  // comment encountered
   if (line.left(2) == R"(\#)") line = line.mid(1);  // escape hash
@@ -93,15 +145,15 @@ void IgnoreList::parseLine(QString prefix, QString line) {
     return;
   }
 
-  addIgnorePattern(prefix + line);
+  addIgnorePattern(patterns, prefix + line);
 }
 
-void IgnoreList::addIgnorePattern(QString pattern, bool can_be_dir) {
-  filters_wildcard_ << pattern;
+void IgnoreList::addIgnorePattern(QStringList& patterns, QString pattern, bool can_be_dir) {
+  patterns << pattern;
   qCDebug(log_ignorelist) << "Added ignore pattern:" << pattern;
   if (can_be_dir) {
     QString pattern_directory = pattern + "/*";  // If it is a directory, then ignore all files inside!
-    filters_wildcard_ << pattern_directory;
+    patterns << pattern_directory;
     qCDebug(log_ignorelist) << "Added helper directory ignore pattern:" << pattern_directory;
   }
 }
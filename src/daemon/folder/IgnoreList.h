@@ -14,10 +14,14 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #pragma once
-#include <QDateTime>
-#include <QReadWriteLock>
+#include <QMap>
+#include <QMutex>
 #include <QStringList>
 #include <QObject>
+#include <atomic>
+#include <memory>
+
+#include "IgnoreMatcher.h"
 
 namespace librevault {
 
@@ -26,23 +30,37 @@ class PathNormalizer;
 
 class IgnoreList : public QObject {
 	Q_OBJECT
+ signals:
+  /* Patterns of the ignore file in this directory changed, paths below it must be re-evaluated */
+  void ignoresChanged(QString abspath);
+
  public:
   IgnoreList(const FolderParams& params, PathNormalizer& path_normalizer, QObject* parent);
 
   bool isIgnored(QByteArray normpath);
 
+  /* Current compiled patterns. The snapshot stays valid after the list is changed. */
+  std::shared_ptr<const IgnoreMatcher> matcher() const { return std::atomic_load(&matcher_); }
+
+  /* Called for every changed or removed path, re-parses it if it is an ignore file */
+  void pathChanged(const QString& abspath);
+
  private:
   const FolderParams& params_;
   PathNormalizer& path_normalizer_;
-  QStringList filters_wildcard_;
 
-  QReadWriteLock ignorelist_mtx;
-  QDateTime last_rebuild_;
+  // Readers never lock, the recompiled matcher is swapped in atomically
+  std::shared_ptr<const IgnoreMatcher> matcher_;
+
+  QMutex ignore_files_mtx_;
+  QMap<QString, QStringList> ignore_files_;  // Patterns by ignore file prefix, "" for the root one
 
-  void lazyRebuildIgnores();
-  void rebuildIgnores();  // not thread-safe!
-  void parseLine(QString prefix, QString line);
-  void addIgnorePattern(QString pattern, bool can_be_dir = true);
+  void discoverIgnoreFiles();
+  QString ignorePrefix(const QString& ignorefile_path);
+  QStringList parseIgnoreFile(const QString& ignorefile_path, const QString& prefix);
+  void compile();  // Under ignore_files_mtx_
+  void parseLine(QStringList& patterns, QString prefix, QString line);
+  void addIgnorePattern(QStringList& patterns, QString pattern, bool can_be_dir = true);
 };
 
 }  // namespace librevault
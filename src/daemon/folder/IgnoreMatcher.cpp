@@ -0,0 +1,109 @@
+/* Copyright (C) 2016 Alexander Shishenko <alex@shishenko.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "IgnoreMatcher.h"
+
+namespace librevault {
+
+namespace {
+
+bool isLiteral(const QString& pattern) {
+  for (QChar c : pattern) {
+    if (c == QLatin1Char('*') || c == QLatin1Char('?') || c == QLatin1Char('[')) return false;
+  }
+  return true;
+}
+
+/* Converts the wildcard the same way QRegExp::Wildcard does. QRegularExpression::wildcardToRegularExpression() is not
+ * used, as its "*" and "?" don't match "/". Returns an empty string for patterns with an unterminated "[", QRegExp
+ * rejects them, so they match nothing. */
+QString wildcardToRegex(const QString& pattern) {
+  QString rx, literal;
+  auto flush_literal = [&] {
+    rx += QRegularExpression::escape(literal);
+    literal.clear();
+  };
+
+  for (int i = 0; i < pattern.size();) {
+    QChar c = pattern[i++];
+    if (c == QLatin1Char('*')) {
+      flush_literal();
+      rx += QLatin1String(".*");
+    } else if (c == QLatin1Char('?')) {
+      flush_literal();
+      rx += QLatin1Char('.');
+    } else if (c == QLatin1Char('[')) {
+      flush_literal();
+      // "^" right after "[" negates the set. "]" right after "[" or "[^" is a member, not the end of the set.
+      QString set = QStringLiteral("[");
+      if (i < pattern.size() && pattern[i] == QLatin1Char('^')) set += pattern[i++];
+      if (i < pattern.size() && pattern[i] == QLatin1Char(']')) {
+        set += QLatin1String("\\]");
+        i++;
+      }
+      while (i < pattern.size() && pattern[i] != QLatin1Char(']')) {
+        QChar member = pattern[i++];
+        if (member == QLatin1Char('\\') || member == QLatin1Char('[')) set += QLatin1Char('\\');
+        set += member;
+      }
+      if (i == pattern.size()) return {};
+      rx += set + QLatin1Char(']');
+      i++;
+    } else
+      literal += c;
+  }
+  flush_literal();
+  return rx;
+}
+
+}  // namespace
+
+IgnoreMatcher::IgnoreMatcher(const QStringList& patterns) : patterns_(patterns) {
+  QStringList wildcard_regexes;
+  for (const QString& pattern : patterns) {
+    if (isLiteral(pattern))
+      exact_.insert(pattern.toCaseFolded());
+    else if (pattern.endsWith(QLatin1String("/*")) && pattern.size() > 2 && isLiteral(pattern.chopped(2)))
+      prefixes_.insert(pattern.chopped(2).toCaseFolded());
+    else if (QString regex = wildcardToRegex(pattern); !regex.isEmpty())
+      wildcard_regexes << QStringLiteral("(?:") + regex + QLatin1Char(')');
+  }
+
+  if (!wildcard_regexes.isEmpty()) {
+    // QRegExp::exactMatch() semantics: the whole path is matched, "." matches a newline too
+    wildcards_.setPattern(QStringLiteral("\\A(?:") + wildcard_regexes.join(QLatin1Char('|')) + QStringLiteral(")\\z"));
+    wildcards_.setPatternOptions(QRegularExpression::CaseInsensitiveOption |
+                                 QRegularExpression::DotMatchesEverythingOption);
+    wildcards_.optimize();
+    has_wildcards_ = true;
+  }
+}
+
+bool IgnoreMatcher::match(const QString& path) const {
+  if (!exact_.isEmpty() || !prefixes_.isEmpty()) {
+    QString folded = path.toCaseFolded();
+    if (exact_.contains(folded)) return true;
+
+    // "dir/*" matches anything below dir, at any depth, as "*" matches "/" too
+    if (!prefixes_.isEmpty()) {
+      for (int slash = folded.indexOf(QLatin1Char('/')); slash > 0; slash = folded.indexOf(QLatin1Char('/'), slash + 1))
+        if (prefixes_.contains(folded.left(slash))) return true;
+    }
+  }
+
+  return has_wildcards_ && wildcards_.match(path).hasMatch();
+}
+
+}  // namespace librevault
@@ -0,0 +1,43 @@
+/* Copyright (C) 2016 Alexander Shishenko <alex@shishenko.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <QRegularExpression>
+#include <QSet>
+#include <QStringList>
+
+namespace librevault {
+
+/* Ignore patterns, compiled for matching. Matches like QDir::match() over the same pattern list, that is with
+ * QRegExp::Wildcard semantics: "*" and "?" match "/" too, "[...]" is a character set. Patterns are converted once:
+ * literal paths and "literal/*" directory patterns are looked up in hash sets, everything else is joined into a single
+ * regular expression. Immutable, so it can be shared between threads without locking. */
+class IgnoreMatcher {
+ public:
+  explicit IgnoreMatcher(const QStringList& patterns);
+
+  bool match(const QString& path) const;
+  const QStringList& patterns() const { return patterns_; }
+
+ private:
+  QStringList patterns_;
+
+  QSet<QString> exact_;     // Case-folded literal paths
+  QSet<QString> prefixes_;  // Case-folded literal directories, everything below them is matched
+  QRegularExpression wildcards_;
+  bool has_wildcards_ = false;
+};
+
+}  // namespace librevault
@@ -16,20 +16,49 @@
 #include "PathNormalizer.h"
 
 #include <util/ffi.h>
-#include <librevault_util/src/path_normalize.rs.h>
 
 #include "control/FolderParams.h"
 
 namespace librevault {
 
-PathNormalizer::PathNormalizer(const FolderParams& params, QObject* parent) : QObject(parent), params_(params) {}
+namespace {
+constexpr int CACHE_ENTRIES = 64 * 1024;
+}  // namespace
+
+PathNormalizer::PathNormalizer(const FolderParams& params, QObject* parent)
+    : QObject(parent),
+      params_(params),
+      normalizer_(normalizer_new(params_.path.toStdString(), params_.normalize_unicode)),
+      normalize_cache_(CACHE_ENTRIES),
+      denormalize_cache_(CACHE_ENTRIES) {}
 
 QByteArray PathNormalizer::normalizePath(const QString& abspath) {
-  return from_vec(normalize_cxx(rust::Str(abspath.toStdString()), rust::Str(params_.path.toStdString()), params_.normalize_unicode));
+  QByteArray normpath;
+  if (normalize_cache_.get(abspath, normpath)) return normpath;
+
+  normpath = from_vec(normalizer_->normalize_cxx(abspath.toStdString()));
+  normalize_cache_.put(abspath, normpath);
+  return normpath;
 }
 
 QString PathNormalizer::denormalizePath(const QByteArray& normpath) {
-  return QString::fromStdString(std::string(denormalize_cxx(to_slice(normpath), params_.path.toStdString())));
+  QString abspath;
+  if (denormalize_cache_.get(normpath, abspath)) return abspath;
+
+  abspath = QString::fromStdString(std::string(normalizer_->denormalize_cxx(to_slice(normpath))));
+  denormalize_cache_.put(normpath, abspath);
+  return abspath;
+}
+
+QList<QByteArray> PathNormalizer::normalizePaths(const QStringList& abspaths) {
+  QList<QByteArray> normpaths;
+  if (abspaths.isEmpty()) return normpaths;
+
+  // Paths can't contain NUL, so it separates them both ways
+  QByteArray joined = abspaths.join(QChar(0)).toUtf8();
+  QByteArray result = from_vec(normalizer_->normalize_batch(rust::Str(joined.constData(), joined.size())));
+  normpaths = result.split('\0');
+  return normpaths;
 }
 
 }  // namespace librevault
@@ -15,8 +15,13 @@
  */
 #pragma once
 #include <QString>
+#include <QStringList>
 #include <QObject>
 
+#include "util/ConcurrentLruCache.h"
+
+#include <librevault_util/src/path_normalize.rs.h>
+
 namespace librevault {
 
 struct FolderParams;
@@ -29,8 +34,16 @@ class PathNormalizer : public QObject {
   QByteArray normalizePath(const QString& abspath);
   QString denormalizePath(const QByteArray& normpath);
 
+  /* Normalizes many paths in one call, e.g. a directory listing. Results are not cached, they are seldom reused. */
+  QList<QByteArray> normalizePaths(const QStringList& abspaths);
+
  private:
   const FolderParams& params_;
+  rust::Box<Normalizer> normalizer_;
+
+  // Each path is normalized or denormalized several times per operation, by the watcher, ignore list and indexer
+  ConcurrentLruCache<QString, QByteArray> normalize_cache_;
+  ConcurrentLruCache<QByteArray, QString> denormalize_cache_;
 };
 
 }  // namespace librevault
@@ -57,7 +57,8 @@ void AssemblerQueue::addAssemble(SignedMeta smeta) {
 void AssemblerQueue::periodicAssembleOperation() {
   qCDebug(log_assembler) << "Performing periodic assemble";
 
-  for (const auto& smeta : meta_storage_->getIncompleteMeta()) addAssemble(smeta);
+  meta_storage_->forEachMeta(MetaStorage::MetaFilter::INCOMPLETE,
+                             [this](const SignedMeta& smeta) { addAssemble(smeta); });
 }
 
 }  // namespace librevault
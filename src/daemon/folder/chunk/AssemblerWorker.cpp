@@ -26,6 +26,7 @@
 #include "folder/PathNormalizer.h"
 #include "folder/chunk/archive/Archive.h"
 #include "folder/meta/MetaStorage.h"
+#include "folder/meta/SuppressionTokens.h"
 #include "util/conv_fspath.h"
 #include "util/readable.h"
 #ifdef Q_OS_UNIX
@@ -70,8 +71,12 @@ void AssemblerWorker::run() noexcept {
   normpath_ = meta_.path(params_.secret);
   denormpath_ = path_normalizer_->denormalizePath(normpath_);
 
+  // Events, caused by the assembly itself, must not be indexed again
+  SuppressionTokens* suppression_tokens = meta_storage_->suppressionTokens();
+  suppression_tokens->begin(normpath_);
+  bool assembled = false;
+
   try {
-    bool assembled = false;
     switch (meta_.meta_type()) {
       case Meta::FILE:
         assembled = assemble_file();
@@ -100,6 +105,11 @@ void AssemblerWorker::run() noexcept {
     qCWarning(log_assembler) << "Unknown exception while assembling:" << meta_.path(params_.secret)
                              << "E:" << e.what();  // FIXME: #83
   }
+
+  if (assembled)
+    suppression_tokens->end(normpath_, denormpath_);
+  else
+    suppression_tokens->cancel(normpath_);
 }
 
 bool AssemblerWorker::assemble_deleted() {
@@ -127,7 +137,6 @@ bool AssemblerWorker::assemble_directory() {
   bool create_new = true;
   if (boost::filesystem::status(denormpath_fs).type() != boost::filesystem::file_type::directory_file)
     create_new = !boost::filesystem::remove(denormpath_fs);
-  meta_storage_->prepareAssemble(normpath_, Meta::DIRECTORY, create_new);
 
   if (create_new) QDir().mkpath(denormpath_);
 
@@ -172,8 +181,6 @@ bool AssemblerWorker::assemble_file() {
     }
   }
 
-  meta_storage_->prepareAssemble(normpath_, Meta::FILE, boost::filesystem::exists(conv_fspath(denormpath_)));
-
   if (!archive_->archive(denormpath_)) {
     qCWarning(log_assembler) << "Item cannot be archived/removed:" << denormpath_;  // FIXME: #83
     throw abort_assembly();
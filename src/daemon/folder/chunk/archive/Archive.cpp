@@ -24,6 +24,7 @@
 #include "control/FolderParams.h"
 #include "folder/PathNormalizer.h"
 #include "folder/meta/MetaStorage.h"
+#include "folder/meta/SuppressionTokens.h"
 #include "util/conv_fspath.h"
 
 namespace librevault {
@@ -54,25 +55,32 @@ bool Archive::archive(const QString& denormpath) {
   auto file_type = boost::filesystem::symlink_status(denormpath_fs).type();
 
   // Suppress unnecessary events on dir_monitor.
-  meta_storage_->prepareAssemble(path_normalizer_->normalizePath(conv_fspath(denormpath_fs)), Meta::DELETED);
+  QByteArray normpath = path_normalizer_->normalizePath(conv_fspath(denormpath_fs));
+  meta_storage_->suppressionTokens()->begin(normpath);
 
-  if (file_type == boost::filesystem::directory_file) {
-    if (boost::filesystem::is_empty(denormpath_fs))  // Okay, just remove this empty directory
-      boost::filesystem::remove(denormpath_fs);
-    else {  // Oh, damn, this is very NOT RIGHT! So, we have DELETED directory with NOT DELETED files in it
-      for (auto it = boost::filesystem::directory_iterator(denormpath_fs);
-           it != boost::filesystem::directory_iterator(); it++)
-        archive(conv_fspath(it->path()));  // TODO: Okay, this is a horrible solution
+  try {
+    if (file_type == boost::filesystem::directory_file) {
+      if (boost::filesystem::is_empty(denormpath_fs))  // Okay, just remove this empty directory
+        boost::filesystem::remove(denormpath_fs);
+      else {  // Oh, damn, this is very NOT RIGHT! So, we have DELETED directory with NOT DELETED files in it
+        for (auto it = boost::filesystem::directory_iterator(denormpath_fs);
+             it != boost::filesystem::directory_iterator(); it++)
+          archive(conv_fspath(it->path()));  // TODO: Okay, this is a horrible solution
+        boost::filesystem::remove(denormpath_fs);
+      }
+    } else if (file_type == boost::filesystem::regular_file) {
+      archive_strategy_->archive(denormpath);
+    } else if (file_type == boost::filesystem::symlink_file || file_type == boost::filesystem::file_not_found) {
       boost::filesystem::remove(denormpath_fs);
+    } else {
+      qWarning() << "Unknown file type, nunable to archive:" << denormpath;
     }
-  } else if (file_type == boost::filesystem::regular_file) {
-    archive_strategy_->archive(denormpath);
-  } else if (file_type == boost::filesystem::symlink_file || file_type == boost::filesystem::file_not_found) {
-    boost::filesystem::remove(denormpath_fs);
-  } else {
-    qWarning() << "Unknown file type, nunable to archive:" << denormpath;
+  } catch (...) {
+    meta_storage_->suppressionTokens()->cancel(normpath);
+    throw;
   }
 
+  meta_storage_->suppressionTokens()->end(normpath, denormpath);
   return true;  // FIXME: handle errors
 }
 
@@ -15,32 +15,76 @@
  */
 #include "DirectoryPoller.h"
 
-#include <QDirIterator>
+#include <QJsonObject>
+#include <QMutex>
+#include <atomic>
+#include <algorithm>
 
 #include "IndexerQueue.h"
 #include "MetaStorage.h"
+#include "ScanJournal.h"
 #include "control/FolderParams.h"
+#include "control/StateCollector.h"
+#include "folder/DirectoryWalker.h"
 #include "folder/IgnoreList.h"
 #include "folder/PathNormalizer.h"
 
 namespace librevault {
 
+namespace {
+
+bool isSubpath(const QByteArray& normpath, const QByteArray& prefix) {
+  return prefix.isEmpty() || normpath == prefix || normpath.startsWith(prefix + '/');
+}
+
+QByteArray parentPath(const QByteArray& normpath) {
+  int slash = normpath.lastIndexOf('/');
+  return slash < 0 ? QByteArray() : normpath.left(slash);
+}
+
+}  // namespace
+
 DirectoryPoller::DirectoryPoller(const FolderParams& params, IgnoreList* ignore_list, PathNormalizer* path_normalizer,
-                                 MetaStorage* parent)
+                                 StateCollector* state_collector, MetaStorage* parent)
     : QObject(parent),
       params_(params),
       meta_storage_(parent),
       ignore_list_(ignore_list),
-      path_normalizer_(path_normalizer) {
+      path_normalizer_(path_normalizer),
+      state_collector_(state_collector) {
   polling_timer_ = new QTimer(this);
   polling_timer_->setInterval(
       std::chrono::duration_cast<std::chrono::milliseconds>(params_.full_rescan_interval).count());
   polling_timer_->setTimerType(Qt::VeryCoarseTimer);
 
   connect(polling_timer_, &QTimer::timeout, this, &DirectoryPoller::addPathsToQueue);
+
+  subtree_timer_ = new QTimer(this);
+  subtree_timer_->setInterval(100);
+  subtree_timer_->setSingleShot(true);
+  connect(subtree_timer_, &QTimer::timeout, this, &DirectoryPoller::rescanPendingSubtrees);
+
+  full_rescan_timer_ = new QTimer(this);
+  full_rescan_timer_->setInterval(100);
+  full_rescan_timer_->setSingleShot(true);
+  connect(full_rescan_timer_, &QTimer::timeout, this, &DirectoryPoller::addPathsToQueue);
+
+  connect(meta_storage_, &MetaStorage::metaAdded, this, &DirectoryPoller::trackIndexedMeta);
+
+  journal_ = std::make_unique<ScanJournal>(params_.system_path);
+  snapshot_loaded_ = journal_->load(snapshot_);
+
+  // With fast rescans enabled, after a clean shutdown only directories, changed while the daemon was not running, have
+  // to be read again. After a crash, file system events of its last moments could be lost, so everything is read,
+  // unless an interrupted rescan can be resumed.
+  if (params_.fast_rescan && snapshot_loaded_ && (journal_->previousShutdownClean() || journal_->resumed()))
+    next_scan_mode_ = ScanMode::FAST;
 }
 
-DirectoryPoller::~DirectoryPoller() {}
+DirectoryPoller::~DirectoryPoller() {
+  if (snapshot_loaded_ && !journal_->save(snapshot_)) return;
+  journal_->markClean();
+}
 
 void DirectoryPoller::setEnabled(bool enabled) {
   if (enabled) {
@@ -50,46 +94,308 @@ void DirectoryPoller::setEnabled(bool enabled) {
     polling_timer_->stop();
 }
 
-QList<QString> DirectoryPoller::getReindexList() {
-  QSet<QString> file_list;
+QHash<QByteArray, FileStat> DirectoryPoller::getFilesystemList(const QString& root, const QSet<QByteArray>& incomplete,
+                                                               ScanMode mode) {
+  QHash<QByteArray, FileStat> file_list;
+  bool follow_symlinks = !params_.preserve_symlinks;
+  bool full_scan = root == params_.path;
+  bool fast = mode == ScanMode::FAST && full_scan && snapshot_loaded_;
 
   // Files present in the file system
-  qDebug() << params_.path;
-  QDirIterator dir_it(params_.path, QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System,
-                      params_.preserve_symlinks ? (QDirIterator::Subdirectories)
-                                                : (QDirIterator::Subdirectories | QDirIterator::FollowSymlinks));
-  while (dir_it.hasNext()) {
-    QString abspath = dir_it.next();
-    QByteArray normpath = path_normalizer_->normalizePath(abspath);
+  if (!full_scan) {
+    QByteArray normpath = path_normalizer_->normalizePath(root);
+    FileStat stat = FileStat::read(root, follow_symlinks);
+    if (stat.type == Meta::DELETED || ignore_list_->isIgnored(normpath)) return file_list;
+    file_list.insert(normpath, stat);
+  }
+
+  QMutex file_list_mtx;
+  std::atomic<int> dirs_total = 0, dirs_skipped = 0;
+  DirectoryWalker walker(params_.scan_threads, follow_symlinks);
+
+  // Contents of unchanged directories are taken from the snapshot
+  QHash<QByteArray, QList<QByteArray>> snapshot_children;
+  if (fast) {
+    for (auto it = snapshot_.cbegin(); it != snapshot_.cend(); ++it)
+      snapshot_children[parentPath(it.key())] << it.key();
+    walker.setCachedListing([&, this](const QString& dir) {
+      QList<DirectoryWalker::Entry> listing;
+      for (const QByteArray& normpath : snapshot_children.value(path_normalizer_->normalizePath(dir)))
+        listing.append({path_normalizer_->denormalizePath(normpath), snapshot_.value(normpath)});
+      return listing;
+    });
+  }
+
+  QMutex unreadable_mtx;
+  walker.setUnreadableHandler([&, this](const QString& dir) {
+    QByteArray normpath = path_normalizer_->normalizePath(dir);
+    LOGW("Could not read directory:" << dir);
+    QMutexLocker lk(&unreadable_mtx);
+    unreadable_dirs_.insert(normpath);
+  });
+
+  if (full_scan) journal_->beginScan();
+  walker.walkListings(root, [&, this](const QString& dir, const QList<DirectoryWalker::Entry>& listing) {
+    QStringList abspaths;
+    abspaths.reserve(listing.size());
+    for (const auto& entry : listing) abspaths << entry.abspath;
+    QList<QByteArray> normpaths = path_normalizer_->normalizePaths(abspaths);
 
-    if (!ignore_list_->isIgnored(normpath)) file_list.insert(abspath);
+    QVector<DirectoryWalker::Action> actions(listing.size(), DirectoryWalker::Action::SKIP);
+    QList<QPair<QByteArray, FileStat>> found;
+    for (int i = 0; i < listing.size(); i++) {
+      if (ignore_list_->isIgnored(normpaths[i])) continue;
+      // Directory mtime changes, when entries are added, removed or renamed in it
+      bool unchanged =
+          fast && listing[i].stat.type == Meta::DIRECTORY && snapshot_.value(normpaths[i]) == listing[i].stat;
+      actions[i] = unchanged ? DirectoryWalker::Action::REUSE : DirectoryWalker::Action::DESCEND;
+      if (listing[i].stat.type == Meta::DIRECTORY) dirs_total++;
+      if (unchanged) dirs_skipped++;
+      // Sockets, devices and such are not indexed
+      if (listing[i].stat.type != Meta::DELETED) found.append({normpaths[i], listing[i].stat});
+    }
+
+    // Empty directories are recorded too, otherwise their stale children would survive the replay
+    if (full_scan) journal_->recordListing(path_normalizer_->normalizePath(dir), found);
+
+    QMutexLocker lk(&file_list_mtx);
+    for (const auto& [normpath, stat] : found) file_list.insert(normpath, stat);
+    return actions;
+  });
+
+  if (full_scan) {
+    LOGD("Rescan read" << dirs_total - dirs_skipped << "of" << dirs_total << "directories");
+    QJsonObject rescan_state{
+        {"mode", fast ? "fast" : "deep"},
+        {"directories", dirs_total.load()},
+        {"directories_skipped", dirs_skipped.load()},
+        {"skipped_ratio", dirs_total ? double(dirs_skipped) / dirs_total : 0.0},
+    };
+    state_collector_->folder_state_set(params_.secret.get_Hash(), "last_rescan", rescan_state);
   }
 
-  // Prevent incomplete (not assembled, partially-downloaded, whatever) from periodical scans.
-  // They can still be indexed by monitor, though.
-  for (auto& smeta : meta_storage_->getIncompleteMeta()) {
-    QString denormpath =
-        path_normalizer_->denormalizePath(smeta.meta().path(params_.secret));
-    file_list.remove(denormpath);
+  // Contents of unreadable directories are not known, so they keep their snapshot entries
+  if (!unreadable_dirs_.isEmpty()) {
+    for (auto it = snapshot_.cbegin(); it != snapshot_.cend(); ++it)
+      if (!file_list.contains(it.key()) && isUnreadable(it.key())) file_list.insert(it.key(), it.value());
   }
 
+  for (const QByteArray& normpath : incomplete) file_list.remove(normpath);
+
+  return file_list;
+}
+
+bool DirectoryPoller::isUnreadable(const QByteArray& normpath) const {
+  if (unreadable_dirs_.isEmpty()) return false;
+  for (QByteArray dir = normpath;; dir = parentPath(dir)) {
+    if (unreadable_dirs_.contains(dir)) return true;
+    if (dir.isEmpty()) return false;
+  }
+}
+
+QSet<QByteArray> DirectoryPoller::getIndexList() {
+  QSet<QByteArray> file_list;
+
   // Files present in index (files added from here will be marked as DELETED)
-  for (auto& smeta : meta_storage_->getExistingMeta()) {
+  meta_storage_->forEachMeta(MetaStorage::MetaFilter::ASSEMBLED, [&, this](const SignedMeta& smeta) {
     QByteArray normpath = smeta.meta().path(params_.secret);
-    QString denormpath = path_normalizer_->denormalizePath(normpath);
+    if (!ignore_list_->isIgnored(normpath)) file_list.insert(normpath);
+  });
 
-    if (!ignore_list_->isIgnored(normpath)) file_list.insert(denormpath);
-  }
+  return file_list;
+}
+
+QSet<QByteArray> DirectoryPoller::getIncompleteList() {
+  QSet<QByteArray> file_list;
+
+  // Prevent incomplete (not assembled, partially-downloaded, whatever) from periodical scans. They are neither new, nor
+  // missing, otherwise a local revision would override the remote one being downloaded. They can still be indexed by
+  // monitor, though.
+  meta_storage_->forEachMeta(MetaStorage::MetaFilter::INCOMPLETE, [&, this](const SignedMeta& smeta) {
+    file_list.insert(smeta.meta().path(params_.secret));
+  });
 
-  return file_list.values();
+  return file_list;
+}
+
+bool DirectoryPoller::isChanged(const QByteArray& normpath, const FileStat& stat) {
+  auto snapshot_it = snapshot_.constFind(normpath);
+  if (snapshot_it == snapshot_.constEnd() || *snapshot_it != stat) return true;
+
+  // Stat is the same, but the file could have failed to index last time
+  try {
+    auto summary = meta_storage_->getMetaSummary(Meta::make_path_id(normpath, params_.secret));
+    if (summary.meta_type != stat.type) return true;
+    // Directories and symlinks are not reindexed on mtime change, so their mtime in the index can be outdated
+    return stat.type == Meta::FILE && summary.mtime != stat.mtime_ns / 1000000000;
+  } catch (MetaStorage::MetaNotFound& e) {
+    return true;
+  }
 }
 
 void DirectoryPoller::addPathsToQueue() {
-  LOGD("Performing full directory rescan");
+  ScanMode mode = snapshot_loaded_ ? next_scan_mode_ : ScanMode::DEEP;
+  scans_since_deep_ = mode == ScanMode::DEEP ? 0 : scans_since_deep_ + 1;
+  // Files, modified in place, don't change mtime of their directory, so they are found by deep rescans only
+  bool next_fast = params_.fast_rescan && scans_since_deep_ + 1 < params_.deep_rescan_every;
+  next_scan_mode_ = next_fast ? ScanMode::FAST : ScanMode::DEEP;
 
-  for (QString denormpath : getReindexList()) {
-    emit newPath(denormpath);
+  LOGD("Performing" << (mode == ScanMode::FAST ? "fast" : "deep") << "full directory rescan");
+
+  QSet<QByteArray> incomplete = getIncompleteList();
+  QHash<QByteArray, FileStat> filesystem_list;
+  unreadable_dirs_.clear();
+  try {
+    filesystem_list = getFilesystemList(params_.path, incomplete, mode);
+  } catch (const std::exception& e) {
+    // A partial list would make the rest of the tree look deleted
+    LOGW("Full rescan is aborted:" << e.what());
+    return;
+  }
+
+  QSet<QByteArray> missing;
+  if (snapshot_loaded_) {
+    for (auto it = snapshot_.cbegin(); it != snapshot_.cend(); ++it) {
+      if (!filesystem_list.contains(it.key()) && !incomplete.contains(it.key())) missing.insert(it.key());
+    }
+  } else {
+    // No snapshot yet, so disappeared paths are taken from the index
+    for (const QByteArray& normpath : getIndexList()) {
+      if (!filesystem_list.contains(normpath) && !isUnreadable(normpath)) missing.insert(normpath);
+    }
+  }
+
+  // Changes, found by the interrupted rescan, are already in the snapshot, so they are reported from the journal
+  const QSet<QByteArray>& replayed = journal_->replayedChanges();
+  for (const QByteArray& normpath : replayed) {
+    if (!filesystem_list.contains(normpath) && !incomplete.contains(normpath)) missing.insert(normpath);
+  }
+
+  QList<QByteArray> changed;
+  for (auto it = filesystem_list.cbegin(); it != filesystem_list.cend(); ++it) {
+    if (isUnreadable(it.key())) continue;
+    if (replayed.contains(it.key()) || isChanged(it.key(), it.value())) changed << it.key();
+  }
+  LOGD("Rescan found" << changed.size() << "changed paths of" << filesystem_list.size());
+
+  emitChanges(missing, changed, filesystem_list);
+
+  // Incomplete paths keep their last known stat until they are assembled
+  for (const QByteArray& normpath : incomplete) {
+    auto snapshot_it = snapshot_.constFind(normpath);
+    if (snapshot_it != snapshot_.constEnd()) filesystem_list.insert(normpath, *snapshot_it);
+  }
+  snapshot_ = std::move(filesystem_list);
+  snapshot_loaded_ = true;
+  journal_->save(snapshot_);
+}
+
+void DirectoryPoller::rescanAll() {
+  if (!full_rescan_timer_->isActive()) full_rescan_timer_->start();
+}
+
+void DirectoryPoller::rescanSubtree(const QString& abspath) {
+  pending_subtrees_.insert(abspath);
+  if (!subtree_timer_->isActive()) subtree_timer_->start();
+}
+
+void DirectoryPoller::rescanPendingSubtrees() {
+  QStringList subtrees = pending_subtrees_.values();
+  pending_subtrees_.clear();
+  LOGD("Rescanning subtrees:" << subtrees);
+
+  QSet<QByteArray> incomplete = getIncompleteList();
+  QList<QByteArray> prefixes;
+  QHash<QByteArray, FileStat> filesystem_list;
+  unreadable_dirs_.clear();
+  try {
+    for (const QString& subtree : subtrees) {
+      prefixes << path_normalizer_->normalizePath(subtree);
+      auto subtree_list = getFilesystemList(subtree, incomplete);
+      for (auto it = subtree_list.cbegin(); it != subtree_list.cend(); ++it)
+        filesystem_list.insert(it.key(), it.value());
+    }
+  } catch (const std::exception& e) {
+    LOGW("Subtree rescan is aborted:" << e.what());
+    return;
   }
+
+  auto in_subtrees = [&](const QByteArray& normpath) {
+    return std::any_of(prefixes.begin(), prefixes.end(),
+                       [&](const QByteArray& prefix) { return isSubpath(normpath, prefix); });
+  };
+
+  QSet<QByteArray> missing;
+  for (auto it = snapshot_.cbegin(); it != snapshot_.cend(); ++it) {
+    if (!filesystem_list.contains(it.key()) && !incomplete.contains(it.key()) && in_subtrees(it.key()))
+      missing.insert(it.key());
+  }
+  // The snapshot has every indexed path, so the whole index is read only before the first full rescan
+  if (!snapshot_loaded_) {
+    for (const QByteArray& normpath : getIndexList()) {
+      if (!filesystem_list.contains(normpath) && in_subtrees(normpath) && !isUnreadable(normpath))
+        missing.insert(normpath);
+    }
+  }
+
+  // Subtree rescans are caused by file system events, so everything is reported, changed or not. Paths in unreadable
+  // directories are only kept from the snapshot.
+  QList<QByteArray> appeared;
+  for (auto it = filesystem_list.cbegin(); it != filesystem_list.cend(); ++it)
+    if (!isUnreadable(it.key())) appeared << it.key();
+  emitChanges(missing, appeared, filesystem_list);
+
+  // Incomplete paths are neither in missing, nor in filesystem_list, so they keep their snapshot entries
+  for (const QByteArray& normpath : missing) snapshot_.remove(normpath);
+  for (auto it = filesystem_list.cbegin(); it != filesystem_list.cend(); ++it) snapshot_.insert(it.key(), it.value());
+}
+
+void DirectoryPoller::trackIndexedMeta(const SignedMeta& smeta) {
+  QByteArray normpath = smeta.meta().path(params_.secret);
+  if (smeta.meta().meta_type() == Meta::DELETED) {
+    snapshot_.remove(normpath);
+    return;
+  }
+
+  // The stat is not known, so the next rescan sees the path as changed, and the indexer rejects it by mtime
+  if (!snapshot_.contains(normpath)) {
+    FileStat stat;
+    stat.type = smeta.meta().meta_type();
+    snapshot_.insert(normpath, stat);
+  }
+}
+
+void DirectoryPoller::emitChanges(QSet<QByteArray> missing, QList<QByteArray> appeared,
+                                  const QHash<QByteArray, FileStat>& filesystem_list) {
+  // A file, that disappeared from one path and appeared on another with the same inode, is moved. Its content is
+  // already indexed, so the indexer doesn't have to read it again.
+  QHash<QPair<quint64, quint64>, QByteArray> missing_files;
+  for (const QByteArray& normpath : missing) {
+    auto snapshot_it = snapshot_.constFind(normpath);
+    if (snapshot_it != snapshot_.constEnd() && snapshot_it->type == Meta::FILE && snapshot_it->inode != 0)
+      missing_files.insert({snapshot_it->dev, snapshot_it->inode}, normpath);
+  }
+
+  int moved = 0;
+  for (auto it = appeared.begin(); it != appeared.end() && !missing_files.isEmpty();) {
+    FileStat stat = filesystem_list.value(*it);
+    QByteArray old_normpath = stat.type == Meta::FILE && !snapshot_.contains(*it)
+                                  ? missing_files.take({stat.dev, stat.inode})
+                                  : QByteArray();
+    if (!old_normpath.isEmpty()) {
+      missing.remove(old_normpath);
+      emit movedPath(path_normalizer_->denormalizePath(old_normpath), path_normalizer_->denormalizePath(*it),
+                     stat.size);
+      it = appeared.erase(it);
+      moved++;
+    } else
+      ++it;
+  }
+  if (moved) LOGD("Paired" << moved << "moved files");
+
+  for (const QByteArray& normpath : missing) emit missingPath(path_normalizer_->denormalizePath(normpath));
+  for (const QByteArray& normpath : appeared)
+    emit newPath(path_normalizer_->denormalizePath(normpath), filesystem_list.value(normpath).size);
 }
 
 }  // namespace librevault
@@ -14,9 +14,14 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #pragma once
+#include <QHash>
+#include <QSet>
 #include <QTimer>
+#include <memory>
 
+#include "FileStat.h"
 #include "Meta.h"
+#include "SignedMeta.h"
 #include "util/log.h"
 
 namespace librevault {
@@ -25,32 +30,71 @@ struct FolderParams;
 class IgnoreList;
 class MetaStorage;
 class PathNormalizer;
+class ScanJournal;
+class StateCollector;
 
 class DirectoryPoller : public QObject {
   Q_OBJECT
   LOG_SCOPE("DirectoryPoller");
  signals:
-  void newPath(QString denormpath);
+  // size is taken from the stat, read by the rescan
+  void newPath(QString denormpath, qint64 size);
+  void missingPath(QString denormpath);
+  void movedPath(QString old_denormpath, QString new_denormpath, qint64 size);
 
  public:
   DirectoryPoller(const FolderParams& params, IgnoreList* ignore_list, PathNormalizer* path_normalizer,
-                  MetaStorage* parent);
+                  StateCollector* state_collector, MetaStorage* parent);
   virtual ~DirectoryPoller();
 
  public slots:
   void setEnabled(bool enabled);
+  void rescanSubtree(const QString& abspath);
+  // Full rescan out of schedule, in the mode the next periodic one would use
+  void rescanAll();
 
  private:
   const FolderParams& params_;
   MetaStorage* meta_storage_;
   IgnoreList* ignore_list_;
   PathNormalizer* path_normalizer_;
+  StateCollector* state_collector_;
 
   QTimer* polling_timer_;
 
-  QList<QString> getReindexList();
+  // Subtree rescans are batched, so the index is read once per batch
+  QTimer* subtree_timer_;
+  QSet<QString> pending_subtrees_;
+  QTimer* full_rescan_timer_;
+
+  /* Stat of every path, found during the last full rescan. Persisted, so unchanged files are not reindexed after
+   * restart. Keys are normalized paths. Paths, indexed from the watcher or put from remote since then, are added with
+   * an empty stat, so their deletion is found by the next rescan. */
+  QHash<QByteArray, FileStat> snapshot_;
+  bool snapshot_loaded_ = false;
+  std::unique_ptr<ScanJournal> journal_;
+
+  enum class ScanMode {
+    DEEP,  // Every directory is read
+    FAST,  // Directories with the same stat as in the snapshot are not read, their contents are taken from it
+  };
+  ScanMode next_scan_mode_ = ScanMode::DEEP;
+  unsigned scans_since_deep_ = 0;
+
+  // Directories, that the current rescan could not read. Nothing below them is reported missing.
+  QSet<QByteArray> unreadable_dirs_;
+  bool isUnreadable(const QByteArray& normpath) const;
+
+  QHash<QByteArray, FileStat> getFilesystemList(const QString& root, const QSet<QByteArray>& incomplete,
+                                                ScanMode mode = ScanMode::DEEP);
+  QSet<QByteArray> getIndexList();
+  QSet<QByteArray> getIncompleteList();
+  bool isChanged(const QByteArray& normpath, const FileStat& stat);
+  void emitChanges(QSet<QByteArray> missing, QList<QByteArray> appeared, const QHash<QByteArray, FileStat>& filesystem_list);
 
   void addPathsToQueue();
+  void rescanPendingSubtrees();
+  void trackIndexedMeta(const SignedMeta& smeta);
 };
 
 }  // namespace librevault
@@ -3,8 +3,12 @@
 #include <QTimer>
 #include <QtCore/QDir>
 #include <QtCore/QDirIterator>
+#include <QtCore/QMutex>
 
+#include "InotifyWatcher.h"
+#include "SuppressionTokens.h"
 #include "control/FolderParams.h"
+#include "folder/DirectoryWalker.h"
 #include "folder/IgnoreList.h"
 #include "folder/PathNormalizer.h"
 
@@ -13,14 +17,41 @@ namespace librevault {
 Q_LOGGING_CATEGORY(log_watcher, "folder.watcher")
 
 DirectoryWatcher::DirectoryWatcher(const FolderParams& params, IgnoreList* ignore_list, PathNormalizer* path_normalizer,
-                                   QObject* parent)
-  : QObject(parent), params_(params), ignore_list_(ignore_list), path_normalizer_(path_normalizer) {
-  watcher_ = new QFileSystemWatcher(this);
-
+                                   SuppressionTokens* suppression_tokens, QObject* parent)
+  : QObject(parent),
+    params_(params),
+    ignore_list_(ignore_list),
+    path_normalizer_(path_normalizer),
+    suppression_tokens_(suppression_tokens) {
   auto native_path = QDir::toNativeSeparators(params.path);
 
   qCDebug(log_watcher) << "DirectoryWatcher:" << native_path;
 
+  connect(suppression_tokens_, &SuppressionTokens::settled, this, &DirectoryWatcher::handleSettled);
+
+#ifdef Q_OS_LINUX
+  InotifyWatcher::Callbacks callbacks;
+  callbacks.is_ignored = [this](const QString& abspath) {
+    return ignore_list_->isIgnored(path_normalizer_->normalizePath(abspath));
+  };
+  callbacks.path_changed = [this](const QString& abspath) { handlePathEvent(abspath); };
+  callbacks.path_moved = [this](const QString& old_abspath, const QString& new_abspath, bool is_dir) {
+    if (is_dir) {
+      emit rescanRequired(old_abspath);
+      emit rescanRequired(new_abspath);
+    } else
+      handleMove(old_abspath, new_abspath);
+  };
+  callbacks.rescan_required = [this](const QString& abspath) { emit rescanRequired(abspath); };
+  callbacks.full_rescan_required = [this] { emit fullRescanRequired(); };
+
+  inotify_ = std::make_unique<InotifyWatcher>(params.path, params.scan_threads, callbacks, this);
+  if (inotify_->isValid()) return;
+  inotify_.reset();  // Falling back to QFileSystemWatcher
+#endif
+
+  watcher_ = new QFileSystemWatcher(this);
+
   addDirectory(native_path, true);
 
   connect(watcher_, &QFileSystemWatcher::directoryChanged, this,
@@ -31,46 +62,69 @@ DirectoryWatcher::DirectoryWatcher(const FolderParams& params, IgnoreList* ignor
 
 DirectoryWatcher::~DirectoryWatcher() = default;
 
-void DirectoryWatcher::prepareAssemble(const QByteArray& normpath, Meta::Type type, bool with_removal) {
-  unsigned skip_events = 0;
-  if (with_removal || type == Meta::Type::DELETED) skip_events++;
-
-  switch (type) {
-    case Meta::FILE:
-      skip_events += 2;  // RENAMED (NEW NAME), MODIFIED
-      break;
-    case Meta::DIRECTORY:
-      skip_events += 1;  // ADDED
-      break;
-    default:;
-  }
-
-  for (unsigned i = 0; i < skip_events; i++) prepared_assemble_.insert(normpath);
-}
-
 void DirectoryWatcher::handlePathEvent(const QString& path) {
   qCDebug(log_watcher) << "handlePathEvent:" << path;
 
+  // Before the suppression check: ignore files, assembled from remote peers, are applied too
+  ignore_list_->pathChanged(path);
+
   QByteArray normpath = path_normalizer_->normalizePath(path);
 
-  auto prepared_assemble_it = prepared_assemble_.find(normpath);
-  if (prepared_assemble_it != prepared_assemble_.end()) {
-    prepared_assemble_.erase(prepared_assemble_it);
-    return;  // FIXME: "prepares" is a dirty hack. It must be EXTERMINATED!
+  if (suppression_tokens_->isPending(normpath)) {
+    deferred_.insert(normpath);
+    return;
+  }
+  if (suppression_tokens_->matches(normpath, path)) {
+    qCDebug(log_watcher) << "Suppressed self-inflicted event:" << path;
+    return;
   }
 
   if (!ignore_list_->isIgnored(normpath)) emit newPath(path);
 }
 
+void DirectoryWatcher::handleMove(const QString& old_path, const QString& new_path) {
+  qCDebug(log_watcher) << "handleMove:" << old_path << "->" << new_path;
+
+  // Moves by the assembler are decided as separate events
+  if (suppression_tokens_->isPending(path_normalizer_->normalizePath(old_path)) ||
+      suppression_tokens_->isPending(path_normalizer_->normalizePath(new_path))) {
+    handlePathEvent(old_path);
+    handlePathEvent(new_path);
+    return;
+  }
+
+  ignore_list_->pathChanged(old_path);
+  ignore_list_->pathChanged(new_path);
+  emit pathMoved(old_path, new_path);
+}
+
+void DirectoryWatcher::handleSettled(const QByteArray& normpath) {
+  if (deferred_.remove(normpath)) handlePathEvent(path_normalizer_->denormalizePath(normpath));
+}
+
+void DirectoryWatcher::watchSubtree(const QString& abspath) {
+  // Newly unignored directories were pruned when the watches were set up. Already watched ones are not duplicated.
+#ifdef Q_OS_LINUX
+  if (inotify_) {
+    inotify_->watchSubtree(abspath);
+    return;
+  }
+#endif
+  addDirectory(abspath, true);
+}
+
 void DirectoryWatcher::addDirectory(const QString& path, bool recursive) {
   QStringList paths;
+  QMutex paths_mtx;
 
-  QDirIterator it(path, QDir::AllEntries | QDir::NoDotAndDotDot,
-    recursive ? QDirIterator::Subdirectories : QDirIterator::NoIteratorFlags);
-  while (it.hasNext()) {
-    QString new_path = it.next();
-    if (!ignore_list_->isIgnored(path_normalizer_->normalizePath(new_path))) paths += new_path;
-  }
+  DirectoryWalker walker(params_.scan_threads, false, false);
+  walker.walk(path, [&, this](const DirectoryWalker::Entry& entry) {
+    if (ignore_list_->isIgnored(path_normalizer_->normalizePath(entry.abspath))) return DirectoryWalker::Action::SKIP;
+
+    QMutexLocker lk(&paths_mtx);
+    paths += entry.abspath;
+    return recursive ? DirectoryWalker::Action::DESCEND : DirectoryWalker::Action::SKIP;
+  });
 
   paths << path;
 
@@ -1,6 +1,7 @@
 #pragma once
 #include <QtCore/QFileSystemWatcher>
-#include <set>
+#include <QSet>
+#include <memory>
 
 #include "Meta.h"
 #include "util/log.h"
@@ -11,31 +12,42 @@ Q_DECLARE_LOGGING_CATEGORY(log_watcher)
 
 struct FolderParams;
 class IgnoreList;
+class InotifyWatcher;
 class PathNormalizer;
+class SuppressionTokens;
 
 class DirectoryWatcher : public QObject {
 Q_OBJECT
 signals:
   void newPath(QString abspath);
+  void pathMoved(QString old_abspath, QString new_abspath);
+  void rescanRequired(QString abspath);
+  void fullRescanRequired();
 
 public:
   DirectoryWatcher(const FolderParams& params, IgnoreList* ignore_list, PathNormalizer* path_normalizer,
-                   QObject* parent);
+                   SuppressionTokens* suppression_tokens, QObject* parent);
   ~DirectoryWatcher() override;
 
-  // A VERY DIRTY HACK
-  void prepareAssemble(const QByteArray& normpath, Meta::Type type, bool with_removal = false);
+  void watchSubtree(const QString& abspath);
 
 private:
   const FolderParams& params_;
   IgnoreList* ignore_list_;
   PathNormalizer* path_normalizer_;
-  QFileSystemWatcher* watcher_;
+  SuppressionTokens* suppression_tokens_;
+  QFileSystemWatcher* watcher_ = nullptr;
+#ifdef Q_OS_LINUX
+  std::unique_ptr<InotifyWatcher> inotify_;
+#endif
 
-  std::multiset<QString> prepared_assemble_;
+  // Events for paths, that were being assembled. Decided when the assembly ends.
+  QSet<QByteArray> deferred_;
 
 private slots:
   void handlePathEvent(const QString& path);
+  void handleMove(const QString& old_path, const QString& new_path);
+  void handleSettled(const QByteArray& normpath);
   void addDirectory(const QString& path, bool recursive);
 };
 
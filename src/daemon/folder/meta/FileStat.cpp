@@ -0,0 +1,78 @@
+/* Copyright (C) 2016 Alexander Shishenko <alex@shishenko.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "FileStat.h"
+
+#include <QFile>
+#include <QFileInfo>
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+
+namespace librevault {
+
+#ifdef Q_OS_UNIX
+FileStat FileStat::read(const QString& abspath, bool follow_symlinks) {
+  FileStat stat;
+
+  struct stat stat_buf = {};
+  QByteArray native_path = QFile::encodeName(abspath);
+  if ((follow_symlinks ? ::stat(native_path.constData(), &stat_buf) : ::lstat(native_path.constData(), &stat_buf)) != 0)
+    return stat;
+
+  if (S_ISREG(stat_buf.st_mode))
+    stat.type = Meta::FILE;
+  else if (S_ISDIR(stat_buf.st_mode))
+    stat.type = Meta::DIRECTORY;
+  else if (S_ISLNK(stat_buf.st_mode))
+    stat.type = Meta::SYMLINK;
+  else
+    return stat;
+
+  stat.dev = stat_buf.st_dev;
+  stat.inode = stat_buf.st_ino;
+  stat.size = stat_buf.st_size;
+#ifdef Q_OS_MAC
+  stat.mtime_ns = qint64(stat_buf.st_mtimespec.tv_sec) * 1000000000 + stat_buf.st_mtimespec.tv_nsec;
+  stat.ctime_ns = qint64(stat_buf.st_ctimespec.tv_sec) * 1000000000 + stat_buf.st_ctimespec.tv_nsec;
+#else
+  stat.mtime_ns = qint64(stat_buf.st_mtim.tv_sec) * 1000000000 + stat_buf.st_mtim.tv_nsec;
+  stat.ctime_ns = qint64(stat_buf.st_ctim.tv_sec) * 1000000000 + stat_buf.st_ctim.tv_nsec;
+#endif
+  return stat;
+}
+#else
+FileStat FileStat::read(const QString& abspath, bool follow_symlinks) {
+  FileStat stat;
+
+  QFileInfo info(abspath);
+  if (!follow_symlinks && info.isSymLink())
+    stat.type = Meta::SYMLINK;
+  else if (info.isDir())
+    stat.type = Meta::DIRECTORY;
+  else if (info.isFile())
+    stat.type = Meta::FILE;
+  else
+    return stat;
+
+  // No inode numbers here, size and timestamps are enough to detect changes
+  stat.size = info.size();
+  stat.mtime_ns = info.lastModified().toMSecsSinceEpoch() * 1000000;
+  stat.ctime_ns = info.metadataChangeTime().toMSecsSinceEpoch() * 1000000;
+  return stat;
+}
+#endif
+
+}  // namespace librevault
@@ -0,0 +1,53 @@
+/* Copyright (C) 2016 Alexander Shishenko <alex@shishenko.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <QDataStream>
+#include <QString>
+
+#include "Meta.h"
+
+namespace librevault {
+
+/* Compact stat() result. If it didn't change, the file is assumed to be unchanged too. */
+struct FileStat {
+  quint64 dev = 0;
+  quint64 inode = 0;
+  qint64 size = 0;
+  qint64 mtime_ns = 0;
+  qint64 ctime_ns = 0;
+  Meta::Type type = Meta::DELETED;  // FILE, DIRECTORY or SYMLINK. DELETED if not found or unsuitable for indexing.
+
+  static FileStat read(const QString& abspath, bool follow_symlinks);
+
+  bool operator==(const FileStat& other) const {
+    return dev == other.dev && inode == other.inode && size == other.size && mtime_ns == other.mtime_ns &&
+           ctime_ns == other.ctime_ns && type == other.type;
+  }
+  bool operator!=(const FileStat& other) const { return !(*this == other); }
+};
+
+inline QDataStream& operator<<(QDataStream& stream, const FileStat& stat) {
+  return stream << stat.dev << stat.inode << stat.size << stat.mtime_ns << stat.ctime_ns << quint8(stat.type);
+}
+
+inline QDataStream& operator>>(QDataStream& stream, FileStat& stat) {
+  quint8 type;
+  stream >> stat.dev >> stat.inode >> stat.size >> stat.mtime_ns >> stat.ctime_ns >> type;
+  stat.type = Meta::Type(type);
+  return stream;
+}
+
+}  // namespace librevault
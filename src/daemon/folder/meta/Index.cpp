@@ -18,31 +18,30 @@
 #include <util/ffi.h>
 
 #include <QFile>
+#include <QSet>
 
 #include "control/FolderParams.h"
 #include "control/StateCollector.h"
 #include "folder/meta/MetaStorage.h"
+#include "folder/meta/IndexerStats.h"
 #include "util/readable.h"
-#include <QJsonDocument>
-#include <QJsonArray>
 #include <QJsonObject>
 
 namespace librevault {
 
 Index::Index(const FolderParams& params, StateCollector* state_collector, QObject* parent)
-    : QObject(parent), params_(params), state_collector_(state_collector), index_(bridge::index_new((params_.system_path + "/librevault.db").toStdString())) {
+    : QObject(parent),
+      params_(params),
+      state_collector_(state_collector),
+      index_(bridge::index_new((params_.system_path + "/librevault.db").toStdString(),
+                               params_.index_synchronous.toStdString(), params_.index_read_connections)),
+      trusted_(params_.index_trusted_load) {
+  flush_timer_ = new QTimer(this);
+  flush_timer_->setSingleShot(true);
+  connect(flush_timer_, &QTimer::timeout, this, [this] { flushPending(); });
 
   index_->c_migrate();
 
-  auto db_filepath = params_.system_path + "/librevault.db";
-
-  if (QFile::exists(db_filepath))
-    LOGD("Opening SQLite3 DB:" << db_filepath);
-  else
-    LOGD("Creating new SQLite3 DB:" << db_filepath);
-  db_ = std::make_unique<SQLiteDB>(db_filepath);
-  db_->exec("PRAGMA foreign_keys = ON;");
-
   /* Create a special hash-file */
   QFile hash_file(params_.system_path + "/hash.txt");
   QByteArray hexhash_conf = params_.secret.get_Hash();
@@ -55,9 +54,12 @@ Index::Index(const FolderParams& params, StateCollector* state_collector, QObjec
   hash_file.write(hexhash_conf);
   hash_file.close();
 
+  loadSummaries();
   notifyState();
 }
 
+Index::~Index() { flushPending(true); }
+
 bool Index::haveMeta(const Meta::PathRevision& path_revision) noexcept {
   try {
     getMeta(path_revision);
@@ -78,65 +80,196 @@ SignedMeta Index::getMeta(const Meta::PathRevision& path_revision) {
 /* Meta manipulators */
 
 void Index::putMeta(const SignedMeta& signed_meta, bool fully_assembled) {
-  QJsonObject signed_meta_str{
-    {"meta", QString::fromLatin1(signed_meta.meta().serialize().toBase64())},
-    {"signature", QString::fromLatin1(signed_meta.signature().toBase64())}
-  };
-  index_->c_put_meta(QString::fromUtf8(QJsonDocument(signed_meta_str).toJson()).toStdString(), fully_assembled);
+  const Meta& meta = signed_meta.meta();
+
+  int pending_size;
+  {
+    // Summary is updated along with the pending Meta, so rollbackSummary() sees either none or both
+    QMutexLocker lk(&pending_mtx_);
+    {
+      QWriteLocker summaries_lk(&summaries_lock_);
+      auto summary_it = summaries_.find(meta.path_id());
+      if (summary_it != summaries_.end())
+        type_counts_[summary_it->meta_type]--;
+      else
+        summary_it = summaries_.insert(meta.path_id(), {});
+      *summary_it = {meta.revision(), meta.mtime(), meta.size(), meta.meta_type()};
+      type_counts_[meta.meta_type()]++;
+    }
+    pending_.insert(meta.path_id(), {signed_meta, fully_assembled});
+    pending_size = pending_.size();
+  }
+  if (pending_size >= FLUSH_BATCH_SIZE)
+    flushPending();
+  else if (pending_size == 1)
+    scheduleFlush(FLUSH_INTERVAL_MS);
 
   emit metaAdded(signed_meta);
   if (!fully_assembled) emit metaAddedExternal(signed_meta);
+}
 
-  notifyState();
+void Index::scheduleFlush(int interval_ms) {
+  // putMeta() is called from indexer threads, the timer lives in ours
+  QMetaObject::invokeMethod(flush_timer_, [this, interval_ms] { flush_timer_->start(interval_ms); },
+                            Qt::QueuedConnection);
 }
 
-QList<SignedMeta> unwrap_rust(const rust::Vec<uint8_t>& data, const Secret& secret) {
-  QList<SignedMeta> result_list;
+void Index::flushPending(bool force) {
+  QMutexLocker flush_lk(&flush_mtx_);
+  if (flush_failing_ && !force && !retry_deadline_.hasExpired()) {
+    // putMeta() could have restarted the timer with a shorter interval
+    scheduleFlush(int(retry_deadline_.remainingTime()));
+    return;
+  }
 
-  auto json = QJsonDocument::fromJson(from_vec(data)).object();
-  auto metas = json["metas"].toArray();
-  for (auto meta_val: metas) {
-    auto meta_obj = meta_val.toObject();
-    auto meta = QByteArray::fromBase64(meta_obj["meta"].toString().toLatin1());
-    auto signature = QByteArray::fromBase64(meta_obj["signature"].toString().toLatin1());
+  QList<PendingPut> batch;
+  {
+    QMutexLocker lk(&pending_mtx_);
+    batch = pending_.values();
+  }
+  if (batch.isEmpty()) return;
+  StageTimer stage_timer(flush_ns_);
 
-    result_list << SignedMeta(meta, signature, secret);
+  rust::Vec<bridge::PutMetaRecord> records;
+  records.reserve(batch.size());
+  for (const PendingPut& put : batch)
+    records.push_back({to_vec(put.smeta.raw_meta()), to_vec(put.smeta.signature()), put.fully_assembled});
+  QSet<int> rejected;
+  try {
+    for (quint32 i : index_->c_put_meta_batch({records.data(), records.size()})) rejected.insert(int(i));
+  } catch (const std::exception& e) {
+    // Nothing is committed. The batch stays pending, and getMeta() keeps serving it until a retry succeeds.
+    if (!flush_failing_) LOGW("Could not write" << batch.size() << "Metas, retrying:" << e.what());
+    flush_failing_ = true;
+    retry_deadline_.setRemainingTime(FLUSH_RETRY_INTERVAL_MS);
+    scheduleFlush(FLUSH_RETRY_INTERVAL_MS);
+    return;
   }
+  if (flush_failing_) LOGD("Pending Metas are written after a failure");
+  flush_failing_ = false;
 
-  return result_list;
+  QList<QByteArray> rolled_back;
+  bool more_pending;
+  {
+    QMutexLocker lk(&pending_mtx_);
+    // The same path could be put again while the batch was being written
+    for (int i = 0; i < batch.size(); i++) {
+      const SignedMeta& smeta = batch[i].smeta;
+      auto pending_it = pending_.find(smeta.meta().path_id());
+      if (pending_it == pending_.end() || pending_it->smeta.signature() != smeta.signature()) continue;
+      pending_.erase(pending_it);
+      if (rejected.contains(i)) rolled_back << smeta.meta().path_id();
+    }
+    more_pending = !pending_.isEmpty();
+  }
+  // Metas put during the write found the timer already scheduled, which has fired since then
+  if (more_pending) scheduleFlush(FLUSH_INTERVAL_MS);
+  // Skipped Metas will never be written, so the summary goes back to what is stored
+  for (const QByteArray& path_id : rolled_back) {
+    LOGW("Meta of" << path_id.toHex() << "could not be decoded by the index and is dropped");
+    rollbackSummary(path_id);
+  }
+
+  // Flushes run on indexer and assembler threads too
+  QMetaObject::invokeMethod(this, [this] { notifyState(); }, Qt::QueuedConnection);
 }
 
-SignedMeta Index::getMeta(const QByteArray& path_id) {
+void Index::flush() { flushPending(); }
+
+void Index::rollbackSummary(const QByteArray& path_id) {
+  QList<SignedMeta> stored;
   try {
-    auto meta_list = unwrap_rust(index_->c_get_meta_by_path_id(to_slice(path_id)), params_.secret);
-    if (meta_list.empty()) throw MetaStorage::MetaNotFound();
-    return meta_list.first();
-  }catch (const std::exception& e) {
-    throw MetaStorage::MetaNotFound();
+    stored = loadMetas(index_->c_get_meta_by_path_id(to_slice(path_id)));
+  } catch (const std::exception& e) {
+    // The stored Meta is broken too, so there is no summary to go back to
   }
+
+  QMutexLocker pending_lk(&pending_mtx_);
+  // The path was put again, and its summary is already newer
+  if (pending_.contains(path_id)) return;
+
+  QWriteLocker lk(&summaries_lock_);
+  auto summary_it = summaries_.find(path_id);
+  if (summary_it != summaries_.end()) {
+    type_counts_[summary_it->meta_type]--;
+    summaries_.erase(summary_it);
+  }
+  if (stored.isEmpty()) return;
+
+  const Meta& meta = stored.first().meta();
+  summaries_.insert(path_id, {meta.revision(), meta.mtime(), meta.size(), meta.meta_type()});
+  type_counts_[meta.meta_type()]++;
 }
-QList<SignedMeta> Index::getMeta() {
+
+SignedMeta Index::loadMeta(const bridge::SignedMetaRecord& record) {
+  quint64 sample = params_.index_verify_sample;
+  bool sampled = trusted_ && sample != 0 && loaded_metas_++ % sample == 0;
   try {
-    return unwrap_rust(index_->c_get_meta_all(), params_.secret);
-  }catch (const std::exception& e) {
-    throw MetaStorage::MetaNotFound();
+    return SignedMeta(from_vec(record.meta), from_vec(record.signature), params_.secret, !trusted_ || sampled);
+  } catch (const SignedMeta::SignatureError& e) {
+    if (sampled && trusted_.exchange(false))
+      LOGW("Index integrity check failed, verifying every loaded Meta from now on");
+    throw;
   }
 }
 
-QList<SignedMeta> Index::getExistingMeta() {
+QList<SignedMeta> Index::loadMetas(const rust::Vec<bridge::SignedMetaRecord>& records) {
+  QList<SignedMeta> result_list;
+  result_list.reserve(records.size());
+  for (const auto& record : records) result_list << loadMeta(record);
+  return result_list;
+}
+
+SignedMeta Index::getMeta(const QByteArray& path_id) {
+  {
+    QMutexLocker lk(&pending_mtx_);
+    auto pending_it = pending_.constFind(path_id);
+    if (pending_it != pending_.constEnd()) return pending_it->smeta;
+  }
+
   try {
-    return unwrap_rust(index_->c_get_meta_assembled(true), params_.secret);
+    auto meta_list = loadMetas(index_->c_get_meta_by_path_id(to_slice(path_id)));
+    if (meta_list.empty()) throw MetaStorage::MetaNotFound();
+    return meta_list.first();
   }catch (const std::exception& e) {
     throw MetaStorage::MetaNotFound();
   }
 }
+MetaStorage::MetaSummary Index::getMetaSummary(const QByteArray& path_id) {
+  QReadLocker lk(&summaries_lock_);
+  auto it = summaries_.constFind(path_id);
+  if (it == summaries_.constEnd()) throw MetaStorage::MetaNotFound();
+  return *it;
+}
 
-QList<SignedMeta> Index::getIncompleteMeta() {
-  try {
-    return unwrap_rust(index_->c_get_meta_assembled(false), params_.secret);
-  }catch (const std::exception& e) {
-    throw MetaStorage::MetaNotFound();
+QList<SignedMeta> Index::getMetaBatch(MetaStorage::MetaFilter filter, QByteArray& after_path_id, int limit,
+                                      bool& at_end) {
+  flushPending();
+
+  bridge::MetaFilter bridge_filter = bridge::MetaFilter::All;
+  if (filter == MetaStorage::MetaFilter::ASSEMBLED) bridge_filter = bridge::MetaFilter::Assembled;
+  if (filter == MetaStorage::MetaFilter::INCOMPLETE) bridge_filter = bridge::MetaFilter::Incomplete;
+
+  bridge::MetaBatch batch = [&] {
+    try {
+      return index_->c_get_meta_batch(bridge_filter, to_slice(after_path_id), limit);
+    } catch (const std::exception& e) {
+      throw MetaStorage::MetaNotFound();
+    }
+  }();
+  at_end = batch.records.size() < size_t(limit);
+  if (!batch.records.empty()) after_path_id = from_vec(batch.last_path_id);
+
+  QList<SignedMeta> result_list;
+  result_list.reserve(batch.records.size());
+  for (const auto& record : batch.records) {
+    try {
+      result_list << loadMeta(record);
+    } catch (const std::exception& e) {
+      LOGW("Skipping invalid Meta:" << e.what());
+    }
   }
+  return result_list;
 }
 
 bool Index::putAllowed(const Meta::PathRevision& path_revision) noexcept {
@@ -148,38 +281,78 @@ bool Index::putAllowed(const Meta::PathRevision& path_revision) noexcept {
 }
 
 void Index::setAssembled(const QByteArray& path_id) {
+  flushPending();
   index_->set_assembled(to_slice(path_id));
 }
 
 bool Index::isAssembledChunk(const QByteArray& ct_hash) {
+  flushPending();
   return index_->is_chunk_assembled(to_slice(ct_hash));
 }
 
 QPair<quint32, QByteArray> Index::getChunkSizeIv(const QByteArray& ct_hash) {
-  for (auto row :
-       db_->exec("SELECT size, iv FROM chunk WHERE ct_hash=:ct_hash", {{":ct_hash", ct_hash}})) {
-    return qMakePair(row[0].toUInt(), row[1].toByteArray());
+  flushPending();
+  try {
+    auto size_iv = index_->c_get_chunk_size_iv(to_slice(ct_hash));
+    return qMakePair(size_iv.size, from_vec(size_iv.iv));
+  } catch (const std::exception& e) {
+    throw MetaStorage::MetaNotFound();
   }
-  throw MetaStorage::MetaNotFound();
-};
+}
 
 QList<SignedMeta> Index::containingChunk(const QByteArray& ct_hash) {
+  flushPending();
   try {
-    return unwrap_rust(index_->c_get_meta_with_chunk(to_slice(ct_hash)), params_.secret);
+    return loadMetas(index_->c_get_meta_with_chunk(to_slice(ct_hash)));
   }catch (const std::exception& e) {
     throw MetaStorage::MetaNotFound();
   }
 }
 
 void Index::wipe() {
+  {
+    QMutexLocker lk(&pending_mtx_);
+    pending_.clear();
+  }
   index_->wipe();
+
+  QWriteLocker lk(&summaries_lock_);
+  summaries_.clear();
+  type_counts_.clear();
+}
+
+void Index::loadSummaries() {
+  QWriteLocker lk(&summaries_lock_);
+  summaries_.clear();
+  type_counts_.clear();
+  for (const auto& summary : index_->c_get_meta_summaries()) {
+    summaries_.insert(from_vec(summary.path_id), {summary.revision, summary.mtime, summary.size,
+                                                  static_cast<Meta::Type>(summary.meta_type)});
+    type_counts_[static_cast<Meta::Type>(summary.meta_type)]++;
+  }
+  LOGD("Prefetched" << summaries_.size() << "Meta summaries");
 }
 
 void Index::notifyState() {
   QJsonObject entries;
-  for (auto row : db_->exec("SELECT type, COUNT(*) AS entries FROM meta GROUP BY type"))
-    entries[QString::number(row[0].toUInt())] = (double)row[1].toUInt();
+  {
+    QReadLocker lk(&summaries_lock_);
+    for (auto it = type_counts_.cbegin(); it != type_counts_.cend(); ++it)
+      if (it.value() > 0) entries[QString::number(it.key())] = (double)it.value();
+  }
   state_collector_->folder_state_set(params_.secret.get_Hash(), "index", entries);
+
+  auto lock_stats_json = [](const bridge::LockStats& stats) {
+    return QJsonObject{
+        {"acquisitions", (double)stats.acquisitions},
+        {"contended", (double)stats.contended},
+        {"wait_ms", stats.wait_ns / 1e6},
+    };
+  };
+  bridge::IndexLockStats lock_stats = index_->c_lock_stats();
+  state_collector_->folder_state_set(
+      params_.secret.get_Hash(), "index_locks",
+      QJsonObject{{"writer", lock_stats_json(lock_stats.writer)}, {"readers", lock_stats_json(lock_stats.readers)}});
 }
 
 }  // namespace librevault
@@ -14,10 +14,16 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #pragma once
+#include <QDeadlineTimer>
+#include <QHash>
+#include <QMutex>
 #include <QObject>
+#include <QReadWriteLock>
+#include <QTimer>
+#include <atomic>
 
+#include "MetaStorage.h"
 #include "SignedMeta.h"
-#include "util/SQLiteWrapper.h"
 #include "util/log.h"
 
 #include <librevault_util/src/index.rs.h>
@@ -36,15 +42,24 @@ class Index : public QObject {
 
  public:
   Index(const FolderParams& params, StateCollector* state_collector, QObject* parent);
+  ~Index() override;
 
   /* Meta manipulators */
   bool haveMeta(const Meta::PathRevision& path_revision) noexcept;
   SignedMeta getMeta(const Meta::PathRevision& path_revision);
   SignedMeta getMeta(const QByteArray& path_id);
-  QList<SignedMeta> getMeta();
-  QList<SignedMeta> getExistingMeta();
-  QList<SignedMeta> getIncompleteMeta();
+  MetaStorage::MetaSummary getMetaSummary(const QByteArray& path_id);
+  /* Reads up to limit Metas after after_path_id and advances it. at_end is set, when there are no more Metas.
+   * Metas with invalid signatures are skipped. */
+  QList<SignedMeta> getMetaBatch(MetaStorage::MetaFilter filter, QByteArray& after_path_id, int limit, bool& at_end);
+  /* Metas are written in batches. Until a batch is committed, the Meta is returned by getMeta(path_id), other reads
+   * commit the pending batch first. If the write fails, the batch stays pending and is retried, meanwhile other reads
+   * see only committed Metas. */
   void putMeta(const SignedMeta& signed_meta, bool fully_assembled = false);
+  // Commits pending Metas now
+  void flush();
+  // Total time, spent committing batches
+  quint64 flushNs() const { return flush_ns_; }
 
   bool putAllowed(const Meta::PathRevision& path_revision) noexcept;
 
@@ -59,13 +74,48 @@ class Index : public QObject {
   const FolderParams& params_;
   StateCollector* state_collector_;
 
-  // Better use SOCI library ( https://github.com/SOCI/soci ). My "reinvented wheel" isn't stable enough.
-  std::unique_ptr<SQLiteDB> db_;
   void wipe();
 
   void notifyState();
 
   rust::Box<bridge::Index> index_;
+
+  /* Trusted load. Index is in our own system directory, and everything in it was verified on put, so signatures are
+   * only checked for a sample of loaded Metas. A mismatch means, that the index was tampered with or corrupted, so
+   * all signatures are checked since then. */
+  std::atomic<bool> trusted_;
+  std::atomic<quint64> loaded_metas_ = 0;
+  SignedMeta loadMeta(const bridge::SignedMetaRecord& record);
+  QList<SignedMeta> loadMetas(const rust::Vec<bridge::SignedMetaRecord>& records);
+
+  /* Summaries of all Metas, prefetched at startup in a single query. Accessed from indexer threads. */
+  QReadWriteLock summaries_lock_;
+  QHash<QByteArray, MetaStorage::MetaSummary> summaries_;
+  QHash<Meta::Type, int> type_counts_;  // Maintained along with summaries_
+  void loadSummaries();
+
+  /* Write batching */
+  struct PendingPut {
+    SignedMeta smeta;
+    bool fully_assembled;
+  };
+  QMutex pending_mtx_;
+  QHash<QByteArray, PendingPut> pending_;  // By path_id. Removed only after being committed.
+  QMutex flush_mtx_;
+  QTimer* flush_timer_;
+  // After a failed write, the batch is kept pending and retried by the timer. Until then, other flushes are skipped.
+  QDeadlineTimer retry_deadline_;  // Guarded by flush_mtx_
+  bool flush_failing_ = false;     // Guarded by flush_mtx_
+  std::atomic<quint64> flush_ns_ = 0;
+
+  static constexpr int FLUSH_BATCH_SIZE = 512;
+  static constexpr int FLUSH_INTERVAL_MS = 100;
+  static constexpr int FLUSH_RETRY_INTERVAL_MS = 1000;
+
+  /* force ignores the retry deadline, used on destruction */
+  void flushPending(bool force = false);
+  void scheduleFlush(int interval_ms);
+  void rollbackSummary(const QByteArray& path_id);
 };
 
 }  // namespace librevault
@@ -15,8 +15,11 @@
  */
 #include "IndexerQueue.h"
 
+#include <QThread>
+
 #include "IndexerWorker.h"
 #include "MetaStorage.h"
+#include "PathStabilizer.h"
 #include "control/FolderParams.h"
 #include "control/StateCollector.h"
 #include "folder/IgnoreList.h"
@@ -37,57 +40,126 @@ IndexerQueue::IndexerQueue(const FolderParams& params, IgnoreList* ignore_list,
       secret_(params.secret) {
   qRegisterMetaType<SignedMeta>("SignedMeta");
   state_collector_->folder_state_set(secret_.get_Hash(), "is_indexing", false);
+  state_collector_->folder_state_set(secret_.get_Hash(), "indexing_bytes_processed", 0);
 
-  connect(this, &IndexerQueue::startedIndexing, this,
-          [this] { state_collector_->folder_state_set(secret_.get_Hash(), "is_indexing", true); });
+  connect(this, &IndexerQueue::startedIndexing, this, [this] {
+    bytes_processed_ = 0;
+    state_collector_->folder_state_set(secret_.get_Hash(), "indexing_bytes_processed", 0);
+    state_collector_->folder_state_set(secret_.get_Hash(), "is_indexing", true);
+  });
   connect(this, &IndexerQueue::finishedIndexing, this,
           [this] { state_collector_->folder_state_set(secret_.get_Hash(), "is_indexing", false); });
 
   threadpool_ = new QThreadPool(this);
+  interactive_threadpool_ = new QThreadPool(this);
+  interactive_threadpool_->setMaxThreadCount(std::max(1, QThread::idealThreadCount() / 4));
+  if (params_.index_threads > 0) {
+    threadpool_->setMaxThreadCount(params_.index_threads);
+    interactive_threadpool_->setMaxThreadCount(std::max(1u, params_.index_threads / 4));
+  }
+
+  stabilizer_ = new PathStabilizer(params_.index_event_timeout, this);
+  connect(stabilizer_, &PathStabilizer::pathStable, this, &IndexerQueue::startIndexing);
+  connect(stabilizer_, &PathStabilizer::suppressedChanged, this, [this](quint64 suppressed) {
+    state_collector_->folder_state_set(secret_.get_Hash(), "indexing_suppressed", (double)suppressed);
+  });
+  state_collector_->folder_state_set(secret_.get_Hash(), "indexing_suppressed", 0);
 }
 
 IndexerQueue::~IndexerQueue() {
   qCDebug(log_indexer) << "~IndexerQueue";
   emit aboutToStop();
   threadpool_->waitForDone();
+  interactive_threadpool_->waitForDone();
   qCDebug(log_indexer) << "!~IndexerQueue";
 }
 
-void IndexerQueue::addIndexing(QString abspath) {
+void IndexerQueue::addIndexing(QString abspath, Priority priority, qint64 size) {
+  auto priority_it = priorities_.find(abspath);
+  if (priority_it == priorities_.end())
+    priorities_.insert(abspath, priority);
+  else if (*priority_it < priority)
+    *priority_it = priority;
+
+  // A path, that the watcher reported as changing, is still waited for
+  if (priority == Priority::BULK && !stabilizer_->isPending(abspath))
+    startIndexing(abspath, size);
+  else
+    stabilizer_->addPath(abspath);
+}
+
+void IndexerQueue::addMove(QString old_abspath, QString new_abspath, Priority priority, qint64 size) {
+  // The old path keeps its Meta until the new one is indexed, as the new Meta takes its chunks from there
+  move_sources_.insert(new_abspath, old_abspath);
+  addIndexing(new_abspath, priority, size);
+}
+
+int IndexerQueue::schedulingPriority(Priority priority, qint64 size) {
+  // Inside one class, smaller files go first. Files are grouped by the order of magnitude of their size.
+  int size_class = 0;
+  for (; size > 0 && size_class < 63; size >>= 1) size_class++;
+  return int(priority) * 64 + (63 - size_class);
+}
+
+void IndexerQueue::startIndexing(QString abspath, qint64 size) {
+  Priority priority = priorities_.take(abspath);
+
   if (tasks_.contains(abspath)) {
     IndexerWorker* worker = tasks_.value(abspath);
-    if (threadpool_->tryTake(worker))
+    if (threadpool_->tryTake(worker) || interactive_threadpool_->tryTake(worker))
       worker->deleteLater();
     else
       worker->stop();
   }
-  auto* worker = new IndexerWorker(abspath, params_, meta_storage_, ignore_list_, path_normalizer_, this);
+  auto* worker = new IndexerWorker(abspath, params_, meta_storage_, ignore_list_, path_normalizer_, &stats_, this);
   worker->setAutoDelete(false);
+  worker->setMoveSource(move_sources_.take(abspath));
   connect(this, &IndexerQueue::aboutToStop, worker, &IndexerWorker::stop, Qt::DirectConnection);
   connect(worker, &IndexerWorker::metaCreated, this, &IndexerQueue::metaCreated);
   connect(worker, &IndexerWorker::metaFailed, this, &IndexerQueue::metaFailed);
+  connect(worker, &IndexerWorker::bytesProcessed, this, &IndexerQueue::bytesProcessed);
   tasks_.insert(abspath, worker);
   if (tasks_.size() == 1) emit startedIndexing();
-  threadpool_->start(worker);
+
+  if (priority == Priority::INTERACTIVE) {
+    if (!threadpool_->tryStart(worker)) interactive_threadpool_->start(worker);
+  } else
+    threadpool_->start(worker, schedulingPriority(priority, size));
 }
 
 void IndexerQueue::metaCreated(SignedMeta smeta) {
   IndexerWorker* worker = qobject_cast<IndexerWorker*>(sender());
-  tasks_.remove(worker->absolutePath());
+  stats_.files_indexed++;
+  stats_.bytes_indexed += smeta.meta().size();
+  {
+    StageTimer put_timer(stats_.index_put_ns);
+    meta_storage_->putMeta(smeta, true);
+  }
+
+  // Finished only after the Meta is in the index
+  finishTask(worker);
+}
+
+void IndexerQueue::finishTask(IndexerWorker* worker) {
+  // A cancelled worker may finish after a new worker for the same path has been started
+  if (tasks_.value(worker->absolutePath()) == worker) tasks_.remove(worker->absolutePath());
   worker->deleteLater();
 
+  if (!worker->moveSource().isEmpty()) addIndexing(worker->moveSource(), Priority::METADATA);
+
   if (tasks_.size() == 0) emit finishedIndexing();
+}
 
-  meta_storage_->putMeta(smeta, true);
+void IndexerQueue::bytesProcessed(quint64 bytes) {
+  bytes_processed_ += bytes;
+  state_collector_->folder_state_set(secret_.get_Hash(), "indexing_bytes_processed", (double)bytes_processed_);
 }
 
 void IndexerQueue::metaFailed(QString error_string) {
   IndexerWorker* worker = qobject_cast<IndexerWorker*>(sender());
-  tasks_.remove(worker->absolutePath());
-  worker->deleteLater();
-
-  if (tasks_.size() == 0) emit finishedIndexing();
+  finishTask(worker);
 
+  stats_.files_skipped++;
   qCWarning(log_indexer) << "Skipping" << worker->absolutePath() << "Reason:" << error_string;
 }
 
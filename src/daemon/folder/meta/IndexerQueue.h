@@ -14,10 +14,12 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #pragma once
+#include <QHash>
 #include <QMap>
 #include <QString>
 #include <QThreadPool>
 
+#include "IndexerStats.h"
 #include "SignedMeta.h"
 
 namespace librevault {
@@ -28,6 +30,7 @@ class IgnoreList;
 class PathNormalizer;
 class StateCollector;
 class IndexerWorker;
+class PathStabilizer;
 class IndexerQueue : public QObject {
   Q_OBJECT
  signals:
@@ -37,12 +40,25 @@ class IndexerQueue : public QObject {
   void finishedIndexing();
 
  public:
+  /* Scheduling classes. Higher classes are always started before lower ones. */
+  enum class Priority : int {
+    BULK = 0,         // Paths found during full rescan
+    METADATA = 1,     // Paths, that are known only from the index (most likely, they are deleted)
+    INTERACTIVE = 2,  // Live changes, reported by the watcher
+  };
+
   IndexerQueue(const FolderParams& params, IgnoreList* ignore_list, PathNormalizer* path_normalizer,
                StateCollector* state_collector, QObject* parent);
   virtual ~IndexerQueue();
 
+  const IndexerStats& stats() const { return stats_; }
+
  public slots:
-  void addIndexing(QString abspath);
+  /* Paths from the watcher are indexed after they stop changing. BULK paths come from a rescan, which has just read
+   * their stat, so they are queued right away with the size it found. */
+  void addIndexing(QString abspath, Priority priority, qint64 size = 0);
+  /* new_abspath is indexed reusing the content of old_abspath, if it is the same file. Then old_abspath is indexed. */
+  void addMove(QString old_abspath, QString new_abspath, Priority priority, qint64 size = 0);
 
  private:
   const FolderParams& params_;
@@ -52,14 +68,25 @@ class IndexerQueue : public QObject {
   StateCollector* state_collector_;
 
   QThreadPool* threadpool_;
+  QThreadPool* interactive_threadpool_;  // Reserved for live changes, so they are not stuck behind a rescan
+  PathStabilizer* stabilizer_;
 
   const Secret& secret_;
 
   QMap<QString, IndexerWorker*> tasks_;
+  QHash<QString, Priority> priorities_;
+  QHash<QString, QString> move_sources_;  // New path -> old path
+  quint64 bytes_processed_ = 0;
+  IndexerStats stats_;
+
+  void finishTask(IndexerWorker* worker);
+  static int schedulingPriority(Priority priority, qint64 size);
 
  private slots:
+  void startIndexing(QString abspath, qint64 size);
   void metaCreated(SignedMeta smeta);
   void metaFailed(QString error_string);
+  void bytesProcessed(quint64 bytes);
 };
 
 }  // namespace librevault
@@ -0,0 +1,47 @@
+/* Copyright (C) 2016 Alexander Shishenko <alex@shishenko.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <QElapsedTimer>
+#include <QtGlobal>
+#include <atomic>
+
+namespace librevault {
+
+/* Cumulative indexer counters. Stage times are summed over all indexing threads, so they can exceed the wall time. */
+struct IndexerStats {
+  std::atomic<quint64> files_indexed{0};
+  std::atomic<quint64> files_skipped{0};
+  std::atomic<quint64> bytes_indexed{0};
+
+  std::atomic<quint64> stat_ns{0};
+  std::atomic<quint64> read_ns{0};  // Reading and finding chunk boundaries
+  std::atomic<quint64> encryption_ns{0};
+  std::atomic<quint64> hashing_ns{0};
+  std::atomic<quint64> index_put_ns{0};
+};
+
+/* Adds its own lifetime to a stage counter */
+class StageTimer {
+ public:
+  explicit StageTimer(std::atomic<quint64>& counter) : counter_(counter) { timer_.start(); }
+  ~StageTimer() { counter_ += timer_.nsecsElapsed(); }
+
+ private:
+  std::atomic<quint64>& counter_;
+  QElapsedTimer timer_;
+};
+
+}  // namespace librevault
@@ -16,9 +16,12 @@
 #include "IndexerWorker.h"
 
 #include <QFile>
+#include <QThread>
 #include <boost/filesystem.hpp>
 
+#include "IndexerStats.h"
 #include "MetaStorage.h"
+#include "SuppressionTokens.h"
 #include "control/FolderParams.h"
 #include "crypto/AES_CBC.h"
 #include "crypto/KMAC-SHA3.h"
@@ -35,26 +38,41 @@
 #endif
 
 #include <util/ffi.h>
-#include <src/common/Meta_s.pb.h>
 
 Q_DECLARE_LOGGING_CATEGORY(log_indexer)
 
 namespace librevault {
 
-Meta::Chunk convert_chunk(const QByteArray& chunk) {
-  auto chunk_s = serialization::Meta_FileMetadata_Chunk();
-  chunk_s.ParseFromArray(chunk.data(), chunk.size());
-  return {QByteArray::fromStdString(chunk_s.ct_hash()), chunk_s.size(), QByteArray::fromStdString(chunk_s.iv()), QByteArray::fromStdString(chunk_s.pt_hmac())};
+Meta::Chunk convert_chunk(const ChunkRecord& chunk) {
+  return {from_vec(chunk.ct_hash), chunk.size, from_vec(chunk.iv), from_vec(chunk.pt_hmac)};
+}
+
+// Chunks are compared by ct_hash, which is unique for every encryption, as IVs are random
+bool isSameContent(const QVector<Meta::Chunk>& old_chunks, const QVector<Meta::Chunk>& new_chunks) {
+  if (old_chunks.size() != new_chunks.size()) return false;
+  for (int i = 0; i < old_chunks.size(); i++)
+    if (old_chunks[i].ct_hash != new_chunks[i].ct_hash) return false;
+  return true;
+}
+
+ReadStrategy convert_read_strategy(FolderParams::ReadStrategy read_strategy) {
+  switch (read_strategy) {
+    case FolderParams::ReadStrategy::LARGE_BUFFER: return ReadStrategy::LargeBuffer;
+    case FolderParams::ReadStrategy::DROP_CACHE: return ReadStrategy::DropCache;
+    default: return ReadStrategy::Buffered;
+  }
 }
 
 IndexerWorker::IndexerWorker(QString abspath, const FolderParams& params, MetaStorage* meta_storage,
-                             IgnoreList* ignore_list, PathNormalizer* path_normalizer, QObject* parent)
+                             IgnoreList* ignore_list, PathNormalizer* path_normalizer, IndexerStats* stats,
+                             QObject* parent)
     : QObject(parent),
       abspath_(abspath),
       params_(params),
       meta_storage_(meta_storage),
       ignore_list_(ignore_list),
       path_normalizer_(path_normalizer),
+      stats_(stats),
       secret_(params.secret),
       active_(true) {}
 
@@ -67,21 +85,31 @@ void IndexerWorker::run() noexcept {
   try {
     if (ignore_list_->isIgnored(normpath)) throw AbortIndex("File is ignored");
 
+    SuppressionTokens* suppression_tokens = meta_storage_->suppressionTokens();
+    if (suppression_tokens->isPending(normpath)) throw AbortIndex("File is being assembled");
+    if (suppression_tokens->matches(normpath, abspath_)) throw AbortIndex("File is not changed since assembly");
+
     auto path_id = Meta::make_path_id(normpath, secret_);
 
     try {
+      // Unchanged files are rejected using the prefetched summary, before the full Meta is read and verified
+      auto summary = meta_storage_->getMetaSummary(path_id);
+
+      boost::system::error_code ec;
+      std::time_t new_mtime;
+      {
+        StageTimer stat_timer(stats_->stat_ns);
+        new_mtime = boost::filesystem::last_write_time(conv_fspath(abspath_), ec);
+      }
+      if (ec)
+        qCDebug(log_indexer) << "Filesystem Error";
+      else if (new_mtime == summary.mtime)
+        throw AbortIndex("Modification time is not changed");
+      else
+        qCDebug(log_indexer) << "Old mtime: " << summary.mtime << " New mtime: " << new_mtime;
+
       old_smeta_ = meta_storage_->getMeta(path_id);
       old_meta_ = old_smeta_.meta();
-
-      auto new_mtime = boost::filesystem::last_write_time(conv_fspath(abspath_));
-
-      if (new_mtime == old_meta_.mtime()) {
-        throw AbortIndex("Modification time is not changed");
-      }else {
-        qCDebug(log_indexer) << "Old mtime: " << old_meta_.mtime() << " New mtime: " << new_mtime;
-      }
-    } catch (boost::filesystem::filesystem_error& e) {
-      qCDebug(log_indexer) << "Filesystem Error";
     } catch (MetaStorage::MetaNotFound& e) {
       qCDebug(log_indexer) << "Meta for path_id: " << path_id << " not found";
     } catch (Meta::error& e) {
@@ -99,7 +127,7 @@ void IndexerWorker::run() noexcept {
                          << "Chk=" << new_smeta_.meta().chunks().size();
 
     emit metaCreated(new_smeta_);
-  } catch (std::runtime_error& e) {
+  } catch (std::exception& e) {
     emit metaFailed(e.what());
   }
 }
@@ -141,6 +169,8 @@ void IndexerWorker::make_Meta() {
 }
 
 Meta::Type IndexerWorker::get_type() {
+  StageTimer stat_timer(stats_->stat_ns);
+
   namespace fs = boost::filesystem;
   fs::file_status file_status = params_.preserve_symlinks
                                     ? fs::symlink_status(conv_fspath(abspath_))
@@ -162,6 +192,8 @@ Meta::Type IndexerWorker::get_type() {
 }
 
 void IndexerWorker::update_fsattrib() {
+  StageTimer stat_timer(stats_->stat_ns);
+
   boost::filesystem::path babspath(abspath_.toStdWString());
 
   // First, preserve old values of attributes
@@ -202,15 +234,84 @@ void IndexerWorker::update_fsattrib() {
 }
 
 void IndexerWorker::update_chunks() {
-  auto d = QJsonDocument::fromJson(from_vec(c_make_chunks(abspath_.toStdString(), secret_.string().toStdString())));
+  if (reuse_moved_chunks()) return;
+
+  // Large files are encrypted and hashed by the process-wide encoder pool of the chunker. This only limits how many
+  // chunks of this file may be in flight at once, so several large files don't multiply the thread count.
+  int threads = params_.index_threads > 0 ? int(params_.index_threads) : QThread::idealThreadCount();
+  auto chunker = chunker_new(abspath_.toStdString(), secret_.string().toStdString(), threads,
+                             convert_read_strategy(params_.index_read_strategy));
+
+  // Plaintext-identical chunks of the previous version are reused as is, so they are not encrypted and hashed again,
+  // and peers don't have to download them.
+  if (old_smeta_ && old_meta_.meta_type() == Meta::FILE) {
+    for (const auto& chunk : old_meta_.chunks())
+      chunker->c_add_known_chunk(to_slice(chunk.ct_hash), chunk.size, to_slice(chunk.iv), to_slice(chunk.pt_hmac));
+  }
 
   QVector<Meta::Chunk> chunks;
-  for(auto chunk_b64 : d.array()) {
-    auto chunk_s = QByteArray::fromBase64(chunk_b64.toString().toLatin1());
-    chunks += convert_chunk(chunk_s);
+  ChunkRecord chunk_record;
+
+  QElapsedTimer progress_timer;
+  progress_timer.start();
+  quint64 bytes_reported = 0;
+
+  while (active_ && chunker->c_next_chunk(chunk_record)) {
+    chunks += convert_chunk(chunk_record);
+
+    if (progress_timer.hasExpired(500)) {
+      emit bytesProcessed(chunker->bytes_processed() - bytes_reported);
+      bytes_reported = chunker->bytes_processed();
+      progress_timer.restart();
+    }
+  }
+  if (!active_) throw AbortIndex("Indexing is cancelled");
+  if (chunker->bytes_processed() != bytes_reported) emit bytesProcessed(chunker->bytes_processed() - bytes_reported);
+
+  auto timings = chunker->c_stage_timings();
+  stats_->read_ns += timings.read_ns;
+  stats_->encryption_ns += timings.encrypt_ns;
+  stats_->hashing_ns += timings.hash_ns;
+
+  qCDebug(log_indexer) << "Reused" << chunker->chunks_reused() << "of" << chunks.size() << "chunks";
+
+  // Known chunks are reused with their ct_hash and IV. If the file is made of the old chunks in the old order (e.g. it
+  // was touched), the content is not changed, and the old chunk list is kept. Then the new revision carries only
+  // metadata changes, and peers don't have to download or assemble anything.
+  if (old_smeta_ && old_meta_.meta_type() == Meta::FILE && isSameContent(old_meta_.chunks(), chunks)) {
+    qCDebug(log_indexer) << "Content is not changed, making metadata-only revision";
+    new_meta_.set_chunks(old_meta_.chunks());
+    return;
   }
 
   new_meta_.set_chunks(chunks);
 }
 
+bool IndexerWorker::reuse_moved_chunks() {
+  if (move_source_.isEmpty()) return false;
+
+  try {
+    Meta moved_meta =
+        meta_storage_->getMeta(Meta::make_path_id(path_normalizer_->normalizePath(move_source_), secret_)).meta();
+    if (moved_meta.meta_type() != Meta::FILE) return false;
+
+    boost::system::error_code ec_size, ec_mtime;
+    uintmax_t size;
+    std::time_t mtime;
+    {
+      StageTimer stat_timer(stats_->stat_ns);
+      size = boost::filesystem::file_size(conv_fspath(abspath_), ec_size);
+      mtime = boost::filesystem::last_write_time(conv_fspath(abspath_), ec_mtime);
+    }
+    if (ec_size || ec_mtime || size != moved_meta.size() || mtime != moved_meta.mtime()) return false;
+
+    qCDebug(log_indexer) << "Moved from" << move_source_ << "without changes, reusing its chunks";
+    new_meta_.set_chunks(moved_meta.chunks());
+    return true;
+  } catch (MetaStorage::MetaNotFound& e) {
+  } catch (Meta::error& e) {
+  }
+  return false;
+}
+
 }  // namespace librevault
@@ -29,6 +29,7 @@ struct FolderParams;
 class MetaStorage;
 class IgnoreList;
 class PathNormalizer;
+struct IndexerStats;
 
 struct MemoryView {
   const char* ptr = nullptr;
@@ -41,6 +42,7 @@ class IndexerWorker : public QObject, public QRunnable {
  signals:
   void metaCreated(SignedMeta smeta);
   void metaFailed(QString errorString);
+  void bytesProcessed(quint64 bytes);
 
  public:
   struct AbortIndex : public std::runtime_error {
@@ -48,21 +50,27 @@ class IndexerWorker : public QObject, public QRunnable {
   };
 
   IndexerWorker(QString abspath, const FolderParams& params, MetaStorage* meta_storage, IgnoreList* ignore_list,
-                PathNormalizer* path_normalizer, QObject* parent);
+                PathNormalizer* path_normalizer, IndexerStats* stats, QObject* parent);
   ~IndexerWorker() override;
 
   [[nodiscard]] QString absolutePath() const { return abspath_; }
 
+  /* The file was moved from this path. If it is unchanged, the chunks of the old Meta are reused without reading it. */
+  void setMoveSource(const QString& abspath) { move_source_ = abspath; }
+  [[nodiscard]] QString moveSource() const { return move_source_; }
+
  public slots:
   void run() noexcept override;
   void stop() { active_ = false; };
 
  private:
   QString abspath_;
+  QString move_source_;
   const FolderParams& params_;
   MetaStorage* meta_storage_;
   IgnoreList* ignore_list_;
   PathNormalizer* path_normalizer_;
+  IndexerStats* stats_;
 
   const Secret& secret_;
 
@@ -78,6 +86,7 @@ class IndexerWorker : public QObject, public QRunnable {
   Meta::Type get_type();
   void update_fsattrib();
   void update_chunks();
+  bool reuse_moved_chunks();
 };
 
 }  // namespace librevault
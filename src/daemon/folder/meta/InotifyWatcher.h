@@ -0,0 +1,87 @@
+/* Copyright (C) 2016 Alexander Shishenko <alex@shishenko.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <functional>
+
+class QSocketNotifier;
+
+namespace librevault {
+
+/* Recursive directory watcher on top of Linux inotify. Only directories are watched, so it needs one watch per
+ * directory instead of one per file. Not a QObject on purpose: it is compiled only on Linux, while moc would process
+ * its header on every platform. */
+class InotifyWatcher {
+ public:
+  struct Callbacks {
+    std::function<bool(const QString& abspath)> is_ignored;
+    std::function<void(const QString& abspath)> path_changed;
+    std::function<void(const QString& old_abspath, const QString& new_abspath, bool is_dir)> path_moved;
+    // Events for the subtree are lost or incomplete, so it must be rescanned
+    std::function<void(const QString& abspath)> rescan_required;
+    // Events anywhere in the tree could be lost
+    std::function<void()> full_rescan_required;
+  };
+
+  InotifyWatcher(const QString& root, unsigned scan_threads, Callbacks callbacks, QObject* parent);
+  ~InotifyWatcher();
+
+  // Adds watches for directories in the subtree, that are not watched yet
+  void watchSubtree(const QString& abspath) { addWatchRecursive(abspath); }
+
+  // false if inotify is not available. The caller should fall back to another watcher.
+  bool isValid() const { return fd_ >= 0; }
+
+ private:
+  QString root_;
+  unsigned scan_threads_;
+  Callbacks callbacks_;
+  int fd_ = -1;
+  QSocketNotifier* notifier_ = nullptr;
+  bool watch_limit_reported_ = false;
+
+  QMutex watches_mtx_;  // Watches are added from the walker threads
+  QHash<int, QString> wd_to_path_;
+  QHash<QString, int> path_to_wd_;
+
+  // IN_MOVED_FROM, waiting for IN_MOVED_TO with the same cookie
+  struct PendingMove {
+    QString abspath;
+    bool is_dir;
+  };
+  QHash<quint32, PendingMove> pending_moves_;
+
+  // Directories with recent events. Rescanned as a whole after IN_Q_OVERFLOW, as lost IN_MODIFY events likely belong
+  // to them.
+  QSet<QString> active_dirs_;
+  QElapsedTimer active_dirs_age_;
+
+  bool addWatch(const QString& dir);
+  void addWatchRecursive(const QString& abspath);
+  void removeWatchRecursive(const QString& abspath);
+  void renameWatchRecursive(const QString& old_abspath, const QString& new_abspath);
+
+  void readEvents();
+  void flushPendingMoves();
+  void handleOverflow();
+};
+
+}  // namespace librevault
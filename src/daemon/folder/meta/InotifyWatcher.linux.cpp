@@ -0,0 +1,222 @@
+/* Copyright (C) 2016 Alexander Shishenko <alex@shishenko.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "InotifyWatcher.h"
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <QFile>
+#include <QMutexLocker>
+#include <QSocketNotifier>
+#include <cerrno>
+#include <cstring>
+
+#include "DirectoryWatcher.h"
+#include "folder/DirectoryWalker.h"
+
+namespace librevault {
+
+namespace {
+
+constexpr uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_FROM |
+                                IN_MOVED_TO | IN_DELETE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+
+// Directories, that had no events for this long, are not considered a part of the current burst
+constexpr qint64 ACTIVE_DIRS_TTL_MS = 60 * 1000;
+
+bool isSubpath(const QString& path, const QString& prefix) {
+  return path == prefix || path.startsWith(prefix + QLatin1Char('/'));
+}
+
+}  // namespace
+
+InotifyWatcher::InotifyWatcher(const QString& root, unsigned scan_threads, Callbacks callbacks, QObject* parent)
+    : root_(root), scan_threads_(scan_threads), callbacks_(std::move(callbacks)) {
+  fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd_ < 0) {
+    qCWarning(log_watcher) << "inotify is not available:" << strerror(errno);
+    return;
+  }
+
+  notifier_ = new QSocketNotifier(fd_, QSocketNotifier::Read, parent);
+  QObject::connect(notifier_, &QSocketNotifier::activated, notifier_, [this] { readEvents(); });
+
+  addWatchRecursive(root_);
+  qCDebug(log_watcher) << "inotify is watching" << wd_to_path_.size() << "directories in" << root_;
+}
+
+InotifyWatcher::~InotifyWatcher() {
+  delete notifier_;
+  if (fd_ >= 0) close(fd_);
+}
+
+bool InotifyWatcher::addWatch(const QString& dir) {
+  int wd = inotify_add_watch(fd_, QFile::encodeName(dir).constData(), WATCH_MASK);
+  int error = errno;
+
+  QMutexLocker lk(&watches_mtx_);
+  if (wd < 0) {
+    if (error == ENOSPC && !watch_limit_reported_) {
+      qCWarning(log_watcher) << "inotify watch limit reached, increase fs.inotify.max_user_watches."
+                             << "Changes in unwatched directories are found by periodic rescans only";
+      watch_limit_reported_ = true;
+    }
+    return false;
+  }
+  wd_to_path_.insert(wd, dir);
+  path_to_wd_.insert(dir, wd);
+  return true;
+}
+
+void InotifyWatcher::addWatchRecursive(const QString& abspath) {
+  if (!addWatch(abspath)) return;
+
+  // Every directory is watched before it is listed, so entries created in the meantime are not missed
+  DirectoryWalker walker(scan_threads_, false, false);
+  walker.walk(abspath, [this](const DirectoryWalker::Entry& entry) {
+    if (entry.stat.type != Meta::DIRECTORY) return DirectoryWalker::Action::SKIP;
+    if (callbacks_.is_ignored(entry.abspath) || !addWatch(entry.abspath)) return DirectoryWalker::Action::SKIP;
+    return DirectoryWalker::Action::DESCEND;
+  });
+}
+
+void InotifyWatcher::removeWatchRecursive(const QString& abspath) {
+  for (auto it = path_to_wd_.begin(); it != path_to_wd_.end();) {
+    if (isSubpath(it.key(), abspath)) {
+      inotify_rm_watch(fd_, it.value());
+      wd_to_path_.remove(it.value());
+      it = path_to_wd_.erase(it);
+    } else
+      ++it;
+  }
+}
+
+void InotifyWatcher::renameWatchRecursive(const QString& old_abspath, const QString& new_abspath) {
+  // Watches survive renames inside the watched tree, only our path mapping must be updated
+  QList<QPair<QString, int>> renamed;
+  for (auto it = path_to_wd_.begin(); it != path_to_wd_.end();) {
+    if (isSubpath(it.key(), old_abspath)) {
+      renamed.append({new_abspath + it.key().mid(old_abspath.size()), it.value()});
+      it = path_to_wd_.erase(it);
+    } else
+      ++it;
+  }
+  for (const auto& [path, wd] : renamed) {
+    path_to_wd_.insert(path, wd);
+    wd_to_path_.insert(wd, path);
+  }
+}
+
+void InotifyWatcher::readEvents() {
+  alignas(struct inotify_event) char buffer[64 * 1024];
+
+  if (!active_dirs_age_.isValid() || active_dirs_age_.hasExpired(ACTIVE_DIRS_TTL_MS)) {
+    active_dirs_.clear();
+    active_dirs_age_.start();
+  }
+
+  for (;;) {
+    ssize_t len = read(fd_, buffer, sizeof(buffer));
+    if (len <= 0) break;
+
+    for (char* ptr = buffer; ptr < buffer + len;) {
+      auto* event = reinterpret_cast<struct inotify_event*>(ptr);
+      ptr += sizeof(struct inotify_event) + event->len;
+
+      if (event->mask & IN_Q_OVERFLOW) {
+        handleOverflow();
+        continue;
+      }
+
+      if (event->mask & IN_IGNORED) {
+        path_to_wd_.remove(wd_to_path_.take(event->wd));
+        continue;
+      }
+
+      auto dir_it = wd_to_path_.constFind(event->wd);
+      if (dir_it == wd_to_path_.constEnd()) continue;
+      const QString& dir = *dir_it;
+      active_dirs_.insert(dir);
+
+      if (event->mask & IN_DELETE_SELF) continue;  // Reported by the parent as IN_DELETE
+
+      QString abspath = dir + QLatin1Char('/') + QFile::decodeName(event->name);
+      bool is_dir = event->mask & IN_ISDIR;
+      if (callbacks_.is_ignored(abspath)) continue;
+
+      if (event->mask & IN_MOVED_FROM) {
+        pending_moves_.insert(event->cookie, {abspath, is_dir});
+      } else if (event->mask & IN_MOVED_TO) {
+        auto pending = pending_moves_.take(event->cookie);
+        if (pending.abspath.isEmpty()) {
+          // Moved in from outside of the watched tree
+          if (is_dir) {
+            addWatchRecursive(abspath);
+            callbacks_.rescan_required(abspath);
+          } else
+            callbacks_.path_changed(abspath);
+        } else {
+          if (is_dir) renameWatchRecursive(pending.abspath, abspath);
+          callbacks_.path_moved(pending.abspath, abspath, is_dir);
+        }
+      } else if (is_dir && (event->mask & IN_CREATE)) {
+        // Entries could be created before the watch was added, so the new directory is scanned as a whole
+        addWatchRecursive(abspath);
+        callbacks_.rescan_required(abspath);
+      } else {
+        callbacks_.path_changed(abspath);
+      }
+    }
+  }
+
+  flushPendingMoves();
+}
+
+void InotifyWatcher::flushPendingMoves() {
+  // Both halves of a rename are queued together, so an unpaired IN_MOVED_FROM is a move out of the watched tree
+  for (const auto& pending : qAsConst(pending_moves_)) {
+    if (pending.is_dir) {
+      removeWatchRecursive(pending.abspath);
+      callbacks_.rescan_required(pending.abspath);
+    } else
+      callbacks_.path_changed(pending.abspath);
+  }
+  pending_moves_.clear();
+}
+
+void InotifyWatcher::handleOverflow() {
+  // Lost events could belong to any directory, so the whole tree is rescanned. A full rescan is fast, but it reads only
+  // directories with a changed stat, so files, modified in place, are looked for in directories active since the
+  // previous overflow. Those are rescanned as a whole.
+  qCWarning(log_watcher) << "inotify queue overflow, rescanning" << root_;
+  callbacks_.full_rescan_required();
+
+  QStringList dirs = active_dirs_.values();
+  std::sort(dirs.begin(), dirs.end());
+
+  QString last_rescanned;
+  for (const QString& dir : dirs) {
+    if (!last_rescanned.isEmpty() && isSubpath(dir, last_rescanned)) continue;
+    qCWarning(log_watcher) << "inotify queue overflow, rescanning" << dir;
+    callbacks_.rescan_required(dir);
+    last_rescanned = dir;
+  }
+
+  active_dirs_.clear();
+  active_dirs_age_.start();
+}
+
+}  // namespace librevault
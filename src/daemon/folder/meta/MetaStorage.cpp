@@ -19,7 +19,9 @@
 #include "DirectoryWatcher.h"
 #include "Index.h"
 #include "IndexerQueue.h"
+#include "SuppressionTokens.h"
 #include "control/FolderParams.h"
+#include "folder/IgnoreList.h"
 #include "folder/PathNormalizer.h"
 
 namespace librevault {
@@ -29,16 +31,42 @@ MetaStorage::MetaStorage(const FolderParams& params, IgnoreList* ignore_list, Pa
     : QObject(parent) {
   index_ = new Index(params, state_collector, this);
   indexer_ = new IndexerQueue(params, ignore_list, path_normalizer, state_collector, this);
-  poller_ = new DirectoryPoller(params, ignore_list, path_normalizer, this);
-  watcher_ = new DirectoryWatcher(params, ignore_list, path_normalizer, this);
+  poller_ = new DirectoryPoller(params, ignore_list, path_normalizer, state_collector, this);
+  suppression_tokens_ = new SuppressionTokens(this);
+  watcher_ = new DirectoryWatcher(params, ignore_list, path_normalizer, suppression_tokens_, this);
 
   if (params.secret.get_type() <= Secret::Type::Owner) {
-    connect(poller_, &DirectoryPoller::newPath, indexer_, &IndexerQueue::addIndexing);
-    connect(watcher_, &DirectoryWatcher::newPath, indexer_, &IndexerQueue::addIndexing);
+    connect(poller_, &DirectoryPoller::newPath, indexer_,
+            [this](QString denormpath, qint64 size) {
+              indexer_->addIndexing(denormpath, IndexerQueue::Priority::BULK, size);
+            });
+    connect(poller_, &DirectoryPoller::missingPath, indexer_,
+            [this](QString denormpath) { indexer_->addIndexing(denormpath, IndexerQueue::Priority::METADATA); });
+    connect(watcher_, &DirectoryWatcher::newPath, indexer_,
+            [this](QString abspath) { indexer_->addIndexing(abspath, IndexerQueue::Priority::INTERACTIVE); });
+    connect(poller_, &DirectoryPoller::movedPath, indexer_,
+            [this](QString old_denormpath, QString new_denormpath, qint64 size) {
+              indexer_->addMove(old_denormpath, new_denormpath, IndexerQueue::Priority::BULK, size);
+            });
+    connect(watcher_, &DirectoryWatcher::pathMoved, indexer_, [this](QString old_abspath, QString new_abspath) {
+      indexer_->addMove(old_abspath, new_abspath, IndexerQueue::Priority::INTERACTIVE);
+    });
+    connect(watcher_, &DirectoryWatcher::rescanRequired, poller_, &DirectoryPoller::rescanSubtree);
+    connect(watcher_, &DirectoryWatcher::fullRescanRequired, poller_, &DirectoryPoller::rescanAll);
+    connect(ignore_list, &IgnoreList::ignoresChanged, poller_, &DirectoryPoller::rescanSubtree);
 
     poller_->setEnabled(true);
   }
 
+  // Ignore files, found by rescans. The watcher reports its events to the IgnoreList itself.
+  connect(poller_, &DirectoryPoller::newPath, ignore_list, &IgnoreList::pathChanged);
+  connect(poller_, &DirectoryPoller::missingPath, ignore_list, &IgnoreList::pathChanged);
+  connect(poller_, &DirectoryPoller::movedPath, ignore_list, [ignore_list](QString old_denormpath, QString new_denormpath) {
+    ignore_list->pathChanged(old_denormpath);
+    ignore_list->pathChanged(new_denormpath);
+  });
+  connect(ignore_list, &IgnoreList::ignoresChanged, watcher_, &DirectoryWatcher::watchSubtree);
+
   connect(index_, &Index::metaAdded, this, &MetaStorage::metaAdded);
   connect(index_, &Index::metaAddedExternal, this, &MetaStorage::metaAddedExternal);
 };
@@ -51,16 +79,33 @@ SignedMeta MetaStorage::getMeta(const Meta::PathRevision& path_revision) { retur
 
 SignedMeta MetaStorage::getMeta(const QByteArray& path_id) { return index_->getMeta(path_id); }
 
-QList<SignedMeta> MetaStorage::getMeta() { return index_->getMeta(); }
+MetaStorage::MetaSummary MetaStorage::getMetaSummary(const QByteArray& path_id) {
+  return index_->getMetaSummary(path_id);
+}
 
-QList<SignedMeta> MetaStorage::getExistingMeta() { return index_->getExistingMeta(); }
+QList<SignedMeta> MetaStorage::MetaCursor::next() {
+  if (at_end_) return {};
+  return index_->getMetaBatch(filter_, last_path_id_, batch_size_, at_end_);
+}
+
+MetaStorage::MetaCursor MetaStorage::metaCursor(MetaFilter filter, int batch_size) {
+  return MetaCursor(index_, filter, batch_size);
+}
 
-QList<SignedMeta> MetaStorage::getIncompleteMeta() { return index_->getIncompleteMeta(); }
+void MetaStorage::forEachMeta(MetaFilter filter, const std::function<void(const SignedMeta&)>& visitor) {
+  MetaCursor cursor = metaCursor(filter);
+  while (!cursor.atEnd())
+    for (const SignedMeta& smeta : cursor.next()) visitor(smeta);
+}
 
 void MetaStorage::putMeta(const SignedMeta& signed_meta, bool fully_assembled) {
   return index_->putMeta(signed_meta, fully_assembled);
 }
 
+void MetaStorage::flush() { index_->flush(); }
+
+quint64 MetaStorage::flushNs() const { return index_->flushNs(); }
+
 QList<SignedMeta> MetaStorage::containingChunk(const QByteArray& ct_hash) { return index_->containingChunk(ct_hash); }
 
 void MetaStorage::markAssembled(const QByteArray& path_id) { index_->setAssembled(path_id); }
@@ -73,8 +118,4 @@ bool MetaStorage::putAllowed(const Meta::PathRevision& path_revision) noexcept {
   return index_->putAllowed(path_revision);
 }
 
-void MetaStorage::prepareAssemble(QByteArray normpath, Meta::Type type, bool with_removal) {
-  watcher_->prepareAssemble(normpath, type, with_removal);
-}
-
 }  // namespace librevault
@@ -15,6 +15,7 @@
  */
 #pragma once
 #include <QObject>
+#include <functional>
 
 #include "SignedMeta.h"
 
@@ -28,6 +29,7 @@ class Index;
 class IndexerQueue;
 class PathNormalizer;
 class StateCollector;
+class SuppressionTokens;
 
 class MetaStorage : public QObject {
   Q_OBJECT
@@ -40,6 +42,35 @@ class MetaStorage : public QObject {
     MetaNotFound() : std::runtime_error("Requested Meta not found") {}
   };
 
+  // Compact in-memory part of a Meta, enough to decide whether a path needs reindexing
+  struct MetaSummary {
+    int64_t revision = 0;
+    int64_t mtime = 0;
+    uint64_t size = 0;
+    Meta::Type meta_type = Meta::FILE;
+  };
+
+  enum class MetaFilter { ALL, ASSEMBLED, INCOMPLETE };
+
+  /* Reads Metas from the index in batches, ordered by path_id, so memory use doesn't grow with the index. Metas, put
+   * behind the cursor during iteration, are not returned. */
+  class MetaCursor {
+   public:
+    QList<SignedMeta> next();
+    bool atEnd() const { return at_end_; }
+
+   private:
+    friend class MetaStorage;
+    MetaCursor(Index* index, MetaFilter filter, int batch_size)
+        : index_(index), filter_(filter), batch_size_(batch_size) {}
+
+    Index* index_;
+    MetaFilter filter_;
+    int batch_size_;
+    QByteArray last_path_id_;
+    bool at_end_ = false;
+  };
+
   MetaStorage(const FolderParams& params, IgnoreList* ignore_list, PathNormalizer* path_normalizer,
               StateCollector* state_collector, QObject* parent);
   virtual ~MetaStorage();
@@ -47,10 +78,12 @@ class MetaStorage : public QObject {
   bool haveMeta(const Meta::PathRevision& path_revision) noexcept;
   SignedMeta getMeta(const Meta::PathRevision& path_revision);
   SignedMeta getMeta(const QByteArray& path_id);
-  QList<SignedMeta> getMeta();
-  QList<SignedMeta> getExistingMeta();
-  QList<SignedMeta> getIncompleteMeta();
+  MetaSummary getMetaSummary(const QByteArray& path_id);
+  MetaCursor metaCursor(MetaFilter filter = MetaFilter::ALL, int batch_size = 1000);
+  void forEachMeta(MetaFilter filter, const std::function<void(const SignedMeta&)>& visitor);
   void putMeta(const SignedMeta& signed_meta, bool fully_assembled = false);
+  void flush();
+  quint64 flushNs() const;
   QList<SignedMeta> containingChunk(const QByteArray& ct_hash);
   QPair<quint32, QByteArray> getChunkSizeIv(const QByteArray& ct_hash);
 
@@ -60,13 +93,15 @@ class MetaStorage : public QObject {
 
   bool putAllowed(const Meta::PathRevision& path_revision) noexcept;
 
-  void prepareAssemble(QByteArray normpath, Meta::Type type, bool with_removal = false);
+  IndexerQueue* indexer() const { return indexer_; }
+  SuppressionTokens* suppressionTokens() const { return suppression_tokens_; }
 
  private:
   Index* index_;
   IndexerQueue* indexer_;
   DirectoryPoller* poller_;
   DirectoryWatcher* watcher_;
+  SuppressionTokens* suppression_tokens_;
 };
 
 }  // namespace librevault
@@ -0,0 +1,102 @@
+/* Copyright (C) 2016 Alexander Shishenko <alex@shishenko.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "PathStabilizer.h"
+
+#include <QFileInfo>
+#include <QLoggingCategory>
+
+Q_DECLARE_LOGGING_CATEGORY(log_indexer)
+
+namespace librevault {
+
+PathStabilizer::PathStabilizer(std::chrono::milliseconds timeout, QObject* parent)
+    : QObject(parent), timeout_(timeout) {
+  clock_.start();
+
+  timer_ = new QTimer(this);
+  timer_->setSingleShot(true);
+  connect(timer_, &QTimer::timeout, this, &PathStabilizer::checkPending);
+}
+
+void PathStabilizer::addPath(const QString& abspath) {
+  if (timeout_.count() <= 0) {
+    emit pathStable(abspath, statPath(abspath).size);
+    return;
+  }
+
+  if (pending_.contains(abspath)) {
+    qCDebug(log_indexer) << "Coalesced event for path:" << abspath;
+    suppress();
+    return;
+  }
+
+  enqueue(abspath, statPath(abspath));
+}
+
+PathStabilizer::PathState PathStabilizer::statPath(const QString& abspath) {
+  QFileInfo file_info(abspath);
+
+  PathState state;
+  state.exists = file_info.exists();
+  if (state.exists) {
+    state.size = file_info.size();
+    state.mtime = file_info.lastModified().toMSecsSinceEpoch();
+  }
+  return state;
+}
+
+void PathStabilizer::enqueue(const QString& abspath, PathState state) {
+  state.deadline = clock_.elapsed() + timeout_.count();
+  pending_.insert(abspath, state);
+  deadlines_.enqueue({state.deadline, abspath});
+
+  if (!timer_->isActive()) rearm();
+}
+
+void PathStabilizer::suppress() {
+  suppressed_++;
+  emit suppressedChanged(suppressed_);
+}
+
+void PathStabilizer::rearm() {
+  if (deadlines_.isEmpty()) return;
+  timer_->start(std::max(qint64(0), deadlines_.head().first - clock_.elapsed()));
+}
+
+void PathStabilizer::checkPending() {
+  qint64 now = clock_.elapsed();
+
+  while (!deadlines_.isEmpty() && deadlines_.head().first <= now) {
+    auto deadline = deadlines_.dequeue();
+
+    auto state_it = pending_.find(deadline.second);
+    if (state_it == pending_.end() || state_it->deadline != deadline.first) continue;
+
+    PathState new_state = statPath(deadline.second);
+    if (new_state == *state_it) {
+      pending_.erase(state_it);
+      emit pathStable(deadline.second, new_state.size);
+    } else {
+      qCDebug(log_indexer) << "Path is still changing:" << deadline.second;
+      suppress();
+      enqueue(deadline.second, new_state);
+    }
+  }
+
+  rearm();
+}
+
+}  // namespace librevault
@@ -0,0 +1,73 @@
+/* Copyright (C) 2016 Alexander Shishenko <alex@shishenko.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QQueue>
+#include <QTimer>
+#include <chrono>
+
+namespace librevault {
+
+/* Holds paths until their size and mtime stop changing for a given timeout. Duplicate events for a path, that is
+ * already waiting, are coalesced into one. */
+class PathStabilizer : public QObject {
+  Q_OBJECT
+ signals:
+  void pathStable(QString abspath, qint64 size);
+  void suppressedChanged(quint64 suppressed);
+
+ public:
+  PathStabilizer(std::chrono::milliseconds timeout, QObject* parent);
+
+  void addPath(const QString& abspath);
+
+  [[nodiscard]] bool isPending(const QString& abspath) const { return pending_.contains(abspath); }
+  [[nodiscard]] quint64 suppressed() const { return suppressed_; }
+
+ private:
+  struct PathState {
+    bool exists = false;
+    qint64 size = 0;
+    qint64 mtime = 0;
+    qint64 deadline = 0;
+
+    bool operator==(const PathState& other) const {
+      return exists == other.exists && size == other.size && mtime == other.mtime;
+    }
+  };
+
+  std::chrono::milliseconds timeout_;
+
+  QHash<QString, PathState> pending_;
+  QQueue<QPair<qint64, QString>> deadlines_;  // Deadlines are always increasing, so this is a sorted queue
+
+  QElapsedTimer clock_;
+  QTimer* timer_;
+
+  quint64 suppressed_ = 0;
+
+  static PathState statPath(const QString& abspath);
+  void enqueue(const QString& abspath, PathState state);
+  void suppress();
+  void rearm();
+
+ private slots:
+  void checkPending();
+};
+
+}  // namespace librevault
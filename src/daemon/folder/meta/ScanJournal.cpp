@@ -0,0 +1,152 @@
+/* Copyright (C) 2016 Alexander Shishenko <alex@shishenko.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "ScanJournal.h"
+
+#include <QSaveFile>
+
+namespace librevault {
+
+namespace {
+
+QByteArray parentPath(const QByteArray& normpath) {
+  int slash = normpath.lastIndexOf('/');
+  return slash < 0 ? QByteArray() : normpath.left(slash);
+}
+
+}  // namespace
+
+ScanJournal::ScanJournal(const QString& system_path)
+    : snapshot_path_(system_path + "/poller.snapshot"),
+      progress_path_(system_path + "/poller.journal"),
+      running_marker_path_(system_path + "/poller.running") {
+  previous_shutdown_clean_ = !QFile::exists(running_marker_path_);
+
+  QFile running_marker(running_marker_path_);
+  running_marker.open(QIODevice::WriteOnly);
+}
+
+ScanJournal::~ScanJournal() { endScan(); }
+
+bool ScanJournal::load(QHash<QByteArray, FileStat>& snapshot) {
+  QFile snapshot_file(snapshot_path_);
+  if (!snapshot_file.open(QIODevice::ReadOnly)) return false;
+
+  QDataStream stream(&snapshot_file);
+  quint32 magic, version;
+  stream >> magic >> version;
+  if (magic != SNAPSHOT_MAGIC || version != SNAPSHOT_VERSION) {
+    LOGD("Ignoring snapshot with unknown format");
+    return false;
+  }
+  stream >> snapshot;
+
+  if (stream.status() != QDataStream::Ok) {
+    LOGD("Snapshot is corrupted, ignoring");
+    snapshot.clear();
+    return false;
+  }
+  LOGD("Loaded snapshot of" << snapshot.size() << "paths");
+
+  replayProgress(snapshot);
+  return true;
+}
+
+void ScanJournal::replayProgress(QHash<QByteArray, FileStat>& snapshot) {
+  QFile progress_file(progress_path_);
+  if (!progress_file.open(QIODevice::ReadOnly)) return;
+
+  QDataStream stream(&progress_file);
+  quint32 magic, version;
+  stream >> magic >> version;
+  if (magic != PROGRESS_MAGIC || version != PROGRESS_VERSION) return;
+
+  QHash<QByteArray, QList<QByteArray>> children;
+  for (auto it = snapshot.cbegin(); it != snapshot.cend(); ++it) children[parentPath(it.key())] << it.key();
+
+  // The last record can be cut off by the crash, it is dropped
+  int replayed = 0;
+  for (;;) {
+    QByteArray dir;
+    QList<QPair<QByteArray, FileStat>> entries;
+    stream >> dir >> entries;
+    if (stream.status() != QDataStream::Ok) break;
+
+    QSet<QByteArray> removed;
+    for (const QByteArray& child : children.take(dir)) removed.insert(child);
+    for (const auto& [normpath, stat] : entries) {
+      removed.remove(normpath);
+      auto snapshot_it = snapshot.find(normpath);
+      if (snapshot_it == snapshot.end() || *snapshot_it != stat) replayed_changes_.insert(normpath);
+      snapshot.insert(normpath, stat);
+    }
+    for (const QByteArray& normpath : removed) {
+      snapshot.remove(normpath);
+      replayed_changes_.insert(normpath);
+    }
+    replayed++;
+  }
+  resumed_ = replayed > 0;
+  if (resumed_) LOGD("Resuming interrupted rescan after" << replayed << "directories");
+}
+
+bool ScanJournal::save(const QHash<QByteArray, FileStat>& snapshot) {
+  QSaveFile snapshot_file(snapshot_path_);
+  if (!snapshot_file.open(QIODevice::WriteOnly)) return false;
+  QDataStream stream(&snapshot_file);
+  stream << SNAPSHOT_MAGIC << SNAPSHOT_VERSION << snapshot;
+  if (!snapshot_file.commit()) return false;  // The journal is still needed
+
+  endScan();
+  QFile::remove(progress_path_);
+  resumed_ = false;
+  replayed_changes_.clear();
+  return true;
+}
+
+void ScanJournal::beginScan() {
+  QMutexLocker lk(&progress_mtx_);
+  progress_file_.close();
+  progress_file_.setFileName(progress_path_);
+  if (!progress_file_.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    LOGW("Could not open scan journal:" << progress_file_.errorString());
+    return;
+  }
+  progress_stream_.setDevice(&progress_file_);
+  progress_stream_ << PROGRESS_MAGIC << PROGRESS_VERSION;
+  progress_flush_timer_.start();
+}
+
+void ScanJournal::recordListing(const QByteArray& dir, const QList<QPair<QByteArray, FileStat>>& entries) {
+  QMutexLocker lk(&progress_mtx_);
+  if (!progress_file_.isOpen()) return;
+
+  progress_stream_ << dir << entries;
+  // Listings in the write buffer are lost on crash, and will be read again
+  if (progress_flush_timer_.hasExpired(1000)) {
+    progress_file_.flush();
+    progress_flush_timer_.restart();
+  }
+}
+
+void ScanJournal::endScan() {
+  QMutexLocker lk(&progress_mtx_);
+  progress_stream_.setDevice(nullptr);
+  progress_file_.close();
+}
+
+void ScanJournal::markClean() { QFile::remove(running_marker_path_); }
+
+}  // namespace librevault
@@ -0,0 +1,84 @@
+/* Copyright (C) 2016 Alexander Shishenko <alex@shishenko.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+
+#include "FileStat.h"
+#include "util/log.h"
+
+namespace librevault {
+
+/* Persistent state of DirectoryPoller in system_path:
+ * - the stat snapshot of the last finished full rescan;
+ * - the progress of the full rescan in progress: every directory listing is appended to a journal as soon as it is
+ *   read, so a rescan, interrupted by a crash or upgrade, is resumed instead of started over;
+ * - a marker, that is present while the daemon runs. If it is found at startup, the previous run didn't shut down
+ *   cleanly, and events of its last moments could be lost. */
+class ScanJournal {
+  LOG_SCOPE("ScanJournal");
+
+ public:
+  explicit ScanJournal(const QString& system_path);
+  ~ScanJournal();
+
+  /* Loads the snapshot. Listings of an interrupted rescan are applied on top of it. */
+  bool load(QHash<QByteArray, FileStat>& snapshot);
+  /* Saves the snapshot and discards the journal of the finished rescan */
+  bool save(const QHash<QByteArray, FileStat>& snapshot);
+
+  bool previousShutdownClean() const { return previous_shutdown_clean_; }
+  /* Listings of an interrupted rescan were applied by load() */
+  bool resumed() const { return resumed_; }
+  /* Paths, that the applied listings changed or removed. The interrupted rescan could have not reported them, and the
+   * loaded snapshot doesn't differ from the file system for them anymore. */
+  const QSet<QByteArray>& replayedChanges() const { return replayed_changes_; }
+
+  void beginScan();
+  /* Thread-safe. entries are the contents of dir, with normalized paths. */
+  void recordListing(const QByteArray& dir, const QList<QPair<QByteArray, FileStat>>& entries);
+
+  /* The daemon is shutting down after the snapshot is saved */
+  void markClean();
+
+ private:
+  QString snapshot_path_;
+  QString progress_path_;
+  QString running_marker_path_;
+
+  bool previous_shutdown_clean_ = false;
+  bool resumed_ = false;
+  QSet<QByteArray> replayed_changes_;
+
+  QMutex progress_mtx_;
+  QFile progress_file_;
+  QDataStream progress_stream_;
+  QElapsedTimer progress_flush_timer_;
+
+  static constexpr quint32 SNAPSHOT_MAGIC = 0x4c565053;  // "LVPS"
+  static constexpr quint32 SNAPSHOT_VERSION = 1;
+  static constexpr quint32 PROGRESS_MAGIC = 0x4c56504a;  // "LVPJ"
+  static constexpr quint32 PROGRESS_VERSION = 1;
+
+  void replayProgress(QHash<QByteArray, FileStat>& snapshot);
+  void endScan();
+};
+
+}  // namespace librevault
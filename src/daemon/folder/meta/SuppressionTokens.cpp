@@ -0,0 +1,107 @@
+/* Copyright (C) 2016 Alexander Shishenko <alex@shishenko.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "SuppressionTokens.h"
+
+#include <QDateTime>
+
+namespace librevault {
+
+namespace {
+
+// Events arrive within seconds, older tokens only waste memory
+constexpr qint64 TOKEN_TTL_MS = 10 * 60 * 1000;
+constexpr qint64 PURGE_INTERVAL_MS = 60 * 1000;
+
+// ctime is not compared: it is changed by the assembler itself when it applies attributes
+bool sameState(const FileStat& a, const FileStat& b) {
+  return a.type == b.type && a.dev == b.dev && a.inode == b.inode && a.size == b.size && a.mtime_ns == b.mtime_ns;
+}
+
+}  // namespace
+
+SuppressionTokens::SuppressionTokens(QObject* parent) : QObject(parent) {}
+
+void SuppressionTokens::begin(const QByteArray& normpath) {
+  QMutexLocker lk(&tokens_mtx_);
+  tokens_[normpath].pending++;
+}
+
+void SuppressionTokens::end(const QByteArray& normpath, const QString& abspath) {
+  FileStat stat = FileStat::read(abspath, false);
+  finish(normpath, &stat);
+}
+
+void SuppressionTokens::cancel(const QByteArray& normpath) { finish(normpath, nullptr); }
+
+void SuppressionTokens::finish(const QByteArray& normpath, const FileStat* stat) {
+  qint64 now_ms = QDateTime::currentMSecsSinceEpoch();
+  bool settled_now;
+  {
+    QMutexLocker lk(&tokens_mtx_);
+    auto it = tokens_.find(normpath);
+    if (it == tokens_.end() || it->pending == 0) return;
+
+    it->pending--;
+    if (stat) {
+      it->recorded = true;
+      it->stat = *stat;
+      it->recorded_ms = now_ms;
+    }
+    settled_now = it->pending == 0;
+    if (settled_now && !it->recorded) tokens_.erase(it);
+
+    if (now_ms >= next_purge_ms_) purge(now_ms);
+  }
+
+  if (settled_now) emit settled(normpath);
+}
+
+bool SuppressionTokens::isPending(const QByteArray& normpath) {
+  QMutexLocker lk(&tokens_mtx_);
+  auto it = tokens_.constFind(normpath);
+  return it != tokens_.constEnd() && it->pending > 0;
+}
+
+bool SuppressionTokens::matches(const QByteArray& normpath, const QString& abspath) {
+  {
+    QMutexLocker lk(&tokens_mtx_);
+    auto it = tokens_.constFind(normpath);
+    if (it == tokens_.constEnd() || !it->recorded) return false;
+  }
+
+  FileStat stat = FileStat::read(abspath, false);
+
+  QMutexLocker lk(&tokens_mtx_);
+  auto it = tokens_.find(normpath);
+  if (it == tokens_.end() || !it->recorded) return false;
+  if (sameState(it->stat, stat)) return true;
+
+  // Changed by someone else since, the token is not needed anymore
+  if (it->pending == 0) tokens_.erase(it);
+  return false;
+}
+
+void SuppressionTokens::purge(qint64 now_ms) {
+  for (auto it = tokens_.begin(); it != tokens_.end();) {
+    if (it->pending == 0 && now_ms - it->recorded_ms > TOKEN_TTL_MS)
+      it = tokens_.erase(it);
+    else
+      ++it;
+  }
+  next_purge_ms_ = now_ms + PURGE_INTERVAL_MS;
+}
+
+}  // namespace librevault
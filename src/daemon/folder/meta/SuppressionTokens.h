@@ -0,0 +1,64 @@
+/* Copyright (C) 2016 Alexander Shishenko <alex@shishenko.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+
+#include "FileStat.h"
+
+namespace librevault {
+
+/* Tracks changes, that the daemon makes to the folder itself. Every assembly is bracketed with begin() and end(), and
+ * end() records the stat of the result. Events, after which the path still has exactly this stat, are self-inflicted
+ * and are dropped by the watcher and the indexer. Any foreign change alters inode, size or mtime, and is not dropped.
+ * Thread-safe. */
+class SuppressionTokens : public QObject {
+  Q_OBJECT
+ signals:
+  /* No more operations on this path are in progress */
+  void settled(QByteArray normpath);
+
+ public:
+  explicit SuppressionTokens(QObject* parent);
+
+  void begin(const QByteArray& normpath);
+  /* Records the current state of abspath as self-inflicted */
+  void end(const QByteArray& normpath, const QString& abspath);
+  /* The operation failed, nothing is recorded */
+  void cancel(const QByteArray& normpath);
+
+  bool isPending(const QByteArray& normpath);
+  /* True if abspath is exactly as the last operation left it */
+  bool matches(const QByteArray& normpath, const QString& abspath);
+
+ private:
+  struct Token {
+    int pending = 0;
+    bool recorded = false;
+    FileStat stat;
+    qint64 recorded_ms = 0;
+  };
+
+  QMutex tokens_mtx_;
+  QHash<QByteArray, Token> tokens_;
+  qint64 next_purge_ms_ = 0;
+
+  void finish(const QByteArray& normpath, const FileStat* stat);
+  void purge(qint64 now_ms);  // Under tokens_mtx_
+};
+
+}  // namespace librevault
@@ -32,8 +32,9 @@ void MetaUploader::broadcast_meta(QList<RemoteFolder*> remotes, const Meta::Path
 }
 
 void MetaUploader::handle_handshake(RemoteFolder* remote) {
-  for (auto& meta : meta_storage_->getMeta())
+  meta_storage_->forEachMeta(MetaStorage::MetaFilter::ALL, [&, this](const SignedMeta& meta) {
     remote->post_have_meta(meta.meta().path_revision(), chunk_storage_->make_bitfield(meta.meta()));
+  });
 }
 
 void MetaUploader::handle_meta_request(RemoteFolder* remote, const Meta::PathRevision& revision) {
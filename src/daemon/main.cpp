@@ -15,6 +15,9 @@
  */
 #include <docopt/docopt.h>
 #include <QtGlobal>
+#include <QCoreApplication>
+#include <QJsonDocument>
+#include <QLoggingCategory>
 #ifdef Q_OS_UNIX
 #include <csignal>
 #endif
@@ -23,6 +26,9 @@
 #include "Client.h"
 #include "Secret.h"
 #include "Version.h"
+#include "bench/IgnoreBenchmark.h"
+#include "bench/IndexBenchmark.h"
+#include "bench/RescanBenchmark.h"
 #include "control/Config.h"
 #include "control/Paths.h"
 
@@ -44,11 +50,28 @@ See on: https://librevault.com
 
 Usage:
   librevault-daemon [-v | -vv] [--data=<dir>]
+  librevault-daemon bench-index <dir> <secret> [--threads=<n>] [--read-strategy=<s>]
+  librevault-daemon bench-ignore <dir> [--iterations=<n>] [--synthetic=<n>]
+  librevault-daemon bench-rescan <dir> [--threads=<n>]
   librevault-daemon (-h | --help)
   librevault-daemon --version
 
+Commands:
+  bench-index             index <dir> into a temporary index and print
+                          throughput as JSON
+  bench-ignore            match every path in <dir> against its ignore
+                          patterns, compiled and with QDir::match
+  bench-rescan            walk <dir> as a full rescan does, with per-path
+                          and batched path normalization
+
 Options:
   --data=<dir>            set application data path
+  --threads=<n>           indexing or scanning threads, 0 for auto
+                          [default: 0]
+  --read-strategy=<s>     buffered, large_buffer or drop_cache
+                          [default: buffered]
+  --iterations=<n>        times every path is matched [default: 10]
+  --synthetic=<n>         extra generated ignore patterns [default: 0]
 
   -h --help               show this screen
   --version               show version
@@ -91,6 +114,40 @@ void rustMessageHandler(QtMsgType msg_type, const QMessageLogContext& ctx, const
   }
 }
 
+int runIndexBenchmark(int argc, char** argv, std::map<std::string, docopt::value>& args) {
+  QCoreApplication app(argc, argv);
+  // Debug output would be a large part of the measured time
+  QLoggingCategory::setFilterRules("*.debug=false");
+
+  IndexBenchmark benchmark(QString::fromStdString(args["<dir>"].asString()),
+                           QString::fromStdString(args["<secret>"].asString()),
+                           QString::fromStdString(args["--threads"].asString()).toUInt(),
+                           QString::fromStdString(args["--read-strategy"].asString()), nullptr);
+  std::cout << QJsonDocument(benchmark.run()).toJson().toStdString();
+  return 0;
+}
+
+int runIgnoreBenchmark(int argc, char** argv, std::map<std::string, docopt::value>& args) {
+  QCoreApplication app(argc, argv);
+  QLoggingCategory::setFilterRules("*.debug=false");
+
+  IgnoreBenchmark benchmark(QString::fromStdString(args["<dir>"].asString()),
+                            QString::fromStdString(args["--iterations"].asString()).toUInt(),
+                            QString::fromStdString(args["--synthetic"].asString()).toUInt(), nullptr);
+  std::cout << QJsonDocument(benchmark.run()).toJson().toStdString();
+  return 0;
+}
+
+int runRescanBenchmark(int argc, char** argv, std::map<std::string, docopt::value>& args) {
+  QCoreApplication app(argc, argv);
+  QLoggingCategory::setFilterRules("*.debug=false");
+
+  RescanBenchmark benchmark(QString::fromStdString(args["<dir>"].asString()),
+                            QString::fromStdString(args["--threads"].asString()).toUInt(), nullptr);
+  std::cout << QJsonDocument(benchmark.run()).toJson().toStdString();
+  return 0;
+}
+
 #ifdef Q_OS_UNIX
 static void setupUnixSignalHandler() {
   struct sigaction sig;
@@ -110,6 +167,10 @@ int main(int argc, char** argv) {
     auto args =
         docopt::docopt(USAGE, {argv + 1, argv + argc}, true, librevault::Version().versionString().toStdString());
 
+    if (args["bench-index"].asBool()) return runIndexBenchmark(argc, argv, args);
+    if (args["bench-ignore"].asBool()) return runIgnoreBenchmark(argc, argv, args);
+    if (args["bench-rescan"].asBool()) return runRescanBenchmark(argc, argv, args);
+
     // Initializing paths
     QString appdata_path;
     if (args["--data"].isString()) appdata_path = QString::fromStdString(args["--data"].asString());
@@ -0,0 +1,66 @@
+/* Copyright (C) 2016 Alexander Shishenko <alex@shishenko.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <QCache>
+#include <QMutex>
+#include <QMutexLocker>
+#include <array>
+
+namespace librevault {
+
+/* Bounded LRU cache, that can be used from many threads. Split into independently locked shards, so concurrent
+ * lookups of different keys rarely contend. Eviction is LRU within a shard. */
+template <typename Key, typename T, size_t Shards = 16>
+class ConcurrentLruCache {
+ public:
+  explicit ConcurrentLruCache(int max_entries) {
+    for (auto& shard : shards_) shard.cache.setMaxCost(qMax(max_entries / int(Shards), 1));
+  }
+
+  bool get(const Key& key, T& value) {
+    Shard& shard = shardFor(key);
+    QMutexLocker lk(&shard.mtx);
+    if (T* cached = shard.cache.object(key)) {
+      value = *cached;
+      return true;
+    }
+    return false;
+  }
+
+  void put(const Key& key, const T& value) {
+    Shard& shard = shardFor(key);
+    QMutexLocker lk(&shard.mtx);
+    shard.cache.insert(key, new T(value));
+  }
+
+  void clear() {
+    for (auto& shard : shards_) {
+      QMutexLocker lk(&shard.mtx);
+      shard.cache.clear();
+    }
+  }
+
+ private:
+  struct Shard {
+    QMutex mtx;
+    QCache<Key, T> cache;
+  };
+  std::array<Shard, Shards> shards_;
+
+  Shard& shardFor(const Key& key) { return shards_[qHash(key) % Shards]; }
+};
+
+}  // namespace librevault
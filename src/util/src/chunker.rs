@@ -0,0 +1,481 @@
+use crate::aescbc::encrypt_chunk;
+use crate::file_reader;
+use crate::file_reader::{FileReader, ReadStrategy};
+use crate::indexer::{Chunk, IndexingError};
+use crate::secret::Secret;
+use log::{debug, trace};
+use rabin::{Rabin, RabinParams};
+use rand::{thread_rng, Fill};
+use sha3::digest::Update;
+use sha3::{Digest, Sha3_224};
+use std::collections::{BTreeMap, HashMap};
+use std::io;
+use std::path::Path;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::mpsc::{sync_channel, Receiver, SyncSender};
+use std::sync::{Arc, Mutex, OnceLock};
+use std::thread;
+use std::time::Instant;
+
+/// Files smaller than this are always chunked on the calling thread.
+pub const PARALLEL_THRESHOLD: u64 = 64 * 1024 * 1024;
+
+pub(crate) fn kmac_sha3_224(key: &[u8], data: &[u8]) -> Vec<u8> {
+    let mut hasher = Sha3_224::new();
+    Update::update(&mut hasher, key);
+    Update::update(&mut hasher, data);
+    hasher.finalize().to_vec()
+}
+
+/// Time spent in each stage of chunking, in nanoseconds. Summed over all threads, so with parallel chunking it can be
+/// larger than the wall time.
+#[derive(Default)]
+pub struct StageTimings {
+    /// Reading and finding chunk boundaries
+    pub read_ns: AtomicU64,
+    pub encrypt_ns: AtomicU64,
+    /// Both pt_hmac and ct_hash
+    pub hash_ns: AtomicU64,
+}
+
+fn record_time(counter: &AtomicU64, started: Instant) {
+    counter.fetch_add(started.elapsed().as_nanos() as u64, Ordering::Relaxed);
+}
+
+fn populate_chunk(
+    data: &[u8],
+    pt_hmac: Vec<u8>,
+    symmetric_key: &[u8],
+    timings: &StageTimings,
+) -> Chunk {
+    debug!("New chunk size: {}", data.len());
+
+    let mut iv = vec![0u8; 16];
+    iv.try_fill(&mut thread_rng()).unwrap();
+
+    let started = Instant::now();
+    let ciphertext = encrypt_chunk(data, symmetric_key, &*iv);
+    record_time(&timings.encrypt_ns, started);
+
+    let started = Instant::now();
+    let ct_hash = Sha3_224::digest(&*ciphertext).to_vec();
+    record_time(&timings.hash_ns, started);
+
+    Chunk {
+        ct_hash,
+        iv,
+        size: data.len() as u32,
+        pt_hmac,
+    }
+}
+
+/// Turns plaintext into chunk metadata: computes pt_hmac, then either reuses a known chunk or encrypts and hashes the
+/// data.
+struct ChunkEncoder {
+    symmetric_key: Vec<u8>,
+    known_chunks: HashMap<Vec<u8>, Chunk>,
+    timings: Arc<StageTimings>,
+}
+
+struct EncodedChunk {
+    chunk: Chunk,
+    reused: bool,
+}
+
+impl ChunkEncoder {
+    fn encode(&self, data: &[u8]) -> EncodedChunk {
+        let started = Instant::now();
+        let pt_hmac = kmac_sha3_224(&self.symmetric_key, data);
+        record_time(&self.timings.hash_ns, started);
+
+        if let Some(known_chunk) = self.known_chunks.get(&pt_hmac) {
+            if known_chunk.size as usize == data.len() {
+                trace!("Reusing known chunk: {}", hex::encode(&known_chunk.ct_hash));
+                return EncodedChunk {
+                    chunk: known_chunk.clone(),
+                    reused: true,
+                };
+            }
+        }
+
+        EncodedChunk {
+            chunk: populate_chunk(data, pt_hmac, &self.symmetric_key, &self.timings),
+            reused: false,
+        }
+    }
+}
+
+type PipelineResult = (u64, io::Result<EncodedChunk>);
+type EncodeJob = Box<dyn FnOnce() + Send>;
+
+struct EncoderPool {
+    jobs: SyncSender<EncodeJob>,
+    receiver: Arc<Mutex<Receiver<EncodeJob>>>,
+    threads: usize,
+}
+
+/// Process-wide pool of threads that encrypt and hash chunks. It is shared by all pipelines, so indexing several large
+/// files at once doesn't spawn a pool per file. The pool grows to the largest `threads` it was asked for (that is,
+/// index_threads of the busiest folder), but never beyond the number of CPUs.
+fn encoder_pool(threads: usize) -> SyncSender<EncodeJob> {
+    static POOL: OnceLock<Mutex<EncoderPool>> = OnceLock::new();
+    let max_threads = thread::available_parallelism().map_or(1, |n| n.get());
+    let mut pool = POOL
+        .get_or_init(|| {
+            let (jobs, receiver) = sync_channel::<EncodeJob>(max_threads * 2);
+            Mutex::new(EncoderPool {
+                jobs,
+                receiver: Arc::new(Mutex::new(receiver)),
+                threads: 0,
+            })
+        })
+        .lock()
+        .unwrap();
+
+    let threads = threads.clamp(1, max_threads);
+    if pool.threads < threads {
+        debug!("Growing chunk encoder pool to {} threads", threads);
+        for _ in pool.threads..threads {
+            let receiver = Arc::clone(&pool.receiver);
+            thread::spawn(move || loop {
+                let job = receiver.lock().unwrap().recv();
+                match job {
+                    Ok(job) => job(),
+                    Err(_) => break,
+                }
+            });
+        }
+        pool.threads = threads;
+    }
+    pool.jobs.clone()
+}
+
+/// Joins the reader thread when dropped. Declared after the receivers in Pipeline, so they are dropped first, and the
+/// reader sees that the pipeline is gone.
+struct ReaderThread(Option<thread::JoinHandle<()>>);
+
+impl Drop for ReaderThread {
+    fn drop(&mut self) {
+        if let Some(handle) = self.0.take() {
+            let _ = handle.join();
+        }
+    }
+}
+
+/// Parallel chunking pipeline for large files. One thread finds chunk boundaries, the shared encoder pool encrypts and
+/// hashes chunks, and results are put back in file order.
+///
+/// At most `window` chunks of a file are in flight (queued, being encoded or waiting to be reordered). The reader takes
+/// a permit before each chunk and the consumer returns it when the chunk is yielded, so pool threads never block on a
+/// full result queue, and a slow consumer only stalls its own reader.
+struct Pipeline {
+    results: Receiver<PipelineResult>,
+    permits: Receiver<()>,
+    reorder_buffer: BTreeMap<u64, io::Result<EncodedChunk>>,
+    next_seq: u64,
+    reader: ReaderThread,
+}
+
+impl Pipeline {
+    fn start(
+        mut rabin: Rabin<FileReader>,
+        encoder: ChunkEncoder,
+        threads: usize,
+        window: usize,
+    ) -> Self {
+        let timings = Arc::clone(&encoder.timings);
+        let encoder = Arc::new(encoder);
+        let (permit_tx, permit_rx) = sync_channel::<()>(window);
+        let (result_tx, result_rx) = sync_channel::<PipelineResult>(window);
+        let job_tx = encoder_pool(threads);
+
+        // The reader exits as soon as the receiving side is dropped, so dropping the Chunker cancels the pipeline. The
+        // drop waits for it, so no reader outlives its file.
+        let reader = thread::spawn(move || {
+            for seq in 0.. {
+                if permit_tx.send(()).is_err() {
+                    break;
+                }
+
+                let started = Instant::now();
+                let data = match rabin.next() {
+                    Some(data) => data,
+                    None => break,
+                };
+                record_time(&timings.read_ns, started);
+
+                match data {
+                    Ok(data) => {
+                        let result_tx = result_tx.clone();
+                        let encoder = Arc::clone(&encoder);
+                        let job: EncodeJob = Box::new(move || {
+                            let _ = result_tx.send((seq, Ok(encoder.encode(&data))));
+                        });
+                        if job_tx.send(job).is_err() {
+                            break;
+                        }
+                    }
+                    Err(e) => {
+                        let _ = result_tx.send((seq, Err(e)));
+                        break;
+                    }
+                }
+            }
+        });
+
+        Pipeline {
+            results: result_rx,
+            permits: permit_rx,
+            reorder_buffer: BTreeMap::new(),
+            next_seq: 0,
+            reader: ReaderThread(Some(reader)),
+        }
+    }
+
+    fn next(&mut self) -> Option<io::Result<EncodedChunk>> {
+        loop {
+            if let Some(result) = self.reorder_buffer.remove(&self.next_seq) {
+                self.next_seq += 1;
+                let _ = self.permits.try_recv();
+                return Some(result);
+            }
+            match self.results.recv() {
+                Ok((seq, result)) => {
+                    self.reorder_buffer.insert(seq, result);
+                }
+                Err(_) => return None,
+            }
+        }
+    }
+}
+
+enum ChunkerState {
+    Idle {
+        rabin: Rabin<FileReader>,
+        encoder: ChunkEncoder,
+    },
+    Sequential {
+        rabin: Rabin<FileReader>,
+        encoder: ChunkEncoder,
+    },
+    Parallel(Pipeline),
+    Finished,
+}
+
+/// Streaming chunker. Yields chunks of a file one by one, so the whole chunk list never has to be kept in memory.
+///
+/// Chunks, whose plaintext matches one of the known chunks (usually, taken from the previous version of the file), are
+/// not encrypted again. Known chunk is reused as is, so its ct_hash stays the same.
+///
+/// Files larger than PARALLEL_THRESHOLD are encrypted and hashed on the shared encoder pool. `threads` limits the share
+/// of the pool one file can take: at most `threads * 2` of its chunks are in flight at a time. The pool has at least
+/// `threads` threads, up to the number of CPUs.
+pub struct Chunker {
+    state: ChunkerState,
+    file_size: u64,
+    threads: usize,
+    bytes_processed: u64,
+    chunks_reused: u64,
+    timings: Arc<StageTimings>,
+}
+
+impl Chunker {
+    pub fn new(
+        path: &Path,
+        secret: &Secret,
+        threads: usize,
+        read_strategy: ReadStrategy,
+    ) -> Result<Self, IndexingError> {
+        trace!(
+            "Trying to make chunks for: {:?} using {:?}",
+            path,
+            read_strategy
+        );
+
+        let (reader, file_size) = file_reader::open(path, read_strategy)?;
+        let timings = Arc::new(StageTimings::default());
+        Ok(Chunker {
+            state: ChunkerState::Idle {
+                rabin: Rabin::new(reader, RabinParams::default()),
+                encoder: ChunkEncoder {
+                    symmetric_key: secret.get_symmetric_key().unwrap().to_vec(),
+                    known_chunks: HashMap::new(),
+                    timings: Arc::clone(&timings),
+                },
+            },
+            file_size,
+            threads,
+            bytes_processed: 0,
+            chunks_reused: 0,
+            timings,
+        })
+    }
+
+    /// Must be called before the first chunk is requested.
+    pub fn add_known_chunk(&mut self, chunk: Chunk) {
+        if let ChunkerState::Idle { encoder, .. } = &mut self.state {
+            encoder.known_chunks.insert(chunk.pt_hmac.clone(), chunk);
+        }
+    }
+
+    pub fn bytes_processed(&self) -> u64 {
+        self.bytes_processed
+    }
+
+    pub fn chunks_reused(&self) -> u64 {
+        self.chunks_reused
+    }
+
+    pub fn stage_timings(&self) -> &StageTimings {
+        &self.timings
+    }
+
+    fn next_encoded(&mut self) -> Option<io::Result<EncodedChunk>> {
+        if let ChunkerState::Idle { .. } = self.state {
+            if let ChunkerState::Idle { rabin, encoder } =
+                std::mem::replace(&mut self.state, ChunkerState::Finished)
+            {
+                self.state = if self.threads > 1 && self.file_size >= PARALLEL_THRESHOLD {
+                    debug!(
+                        "Starting parallel chunking with {} chunks in flight",
+                        self.threads * 2
+                    );
+                    ChunkerState::Parallel(Pipeline::start(
+                        rabin,
+                        encoder,
+                        self.threads,
+                        self.threads * 2,
+                    ))
+                } else {
+                    ChunkerState::Sequential { rabin, encoder }
+                };
+            }
+        }
+
+        match &mut self.state {
+            ChunkerState::Sequential { rabin, encoder } => {
+                let started = Instant::now();
+                let data = rabin.next()?;
+                record_time(&self.timings.read_ns, started);
+                Some(data.map(|data| encoder.encode(&data)))
+            }
+            ChunkerState::Parallel(pipeline) => pipeline.next(),
+            _ => None,
+        }
+    }
+}
+
+impl Iterator for Chunker {
+    type Item = Result<Chunk, IndexingError>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        match self.next_encoded()? {
+            Ok(encoded) => {
+                self.bytes_processed += encoded.chunk.size as u64;
+                if encoded.reused {
+                    self.chunks_reused += 1;
+                }
+                Some(Ok(encoded.chunk))
+            }
+            Err(e) => {
+                self.state = ChunkerState::Finished;
+                Some(Err(IndexingError::from(e)))
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::io::Write;
+    use std::time::Instant;
+
+    fn make_test_file(size: usize) -> tempfile::NamedTempFile {
+        let mut tempf = tempfile::NamedTempFile::new().unwrap();
+        let mut state = 0x12345678u32;
+        let data: Vec<u8> = (0..size)
+            .map(|_| {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                state as u8
+            })
+            .collect();
+        tempf.write_all(&data).unwrap();
+        tempf
+    }
+
+    #[test]
+    fn test_parallel_matches_sequential() {
+        let secret = Secret::new();
+        let tempf = make_test_file(PARALLEL_THRESHOLD as usize + 3 * 1024 * 1024);
+
+        let sequential = Chunker::new(tempf.path(), &secret, 1, ReadStrategy::Buffered)
+            .unwrap()
+            .collect::<Result<Vec<Chunk>, IndexingError>>()
+            .unwrap();
+        let parallel = Chunker::new(tempf.path(), &secret, 4, ReadStrategy::Buffered)
+            .unwrap()
+            .collect::<Result<Vec<Chunk>, IndexingError>>()
+            .unwrap();
+
+        // IVs are random, so only plaintext-derived fields are comparable
+        assert_eq!(sequential.len(), parallel.len());
+        for (s, p) in sequential.iter().zip(parallel.iter()) {
+            assert_eq!(s.size, p.size);
+            assert_eq!(s.pt_hmac, p.pt_hmac);
+        }
+    }
+
+    /// Throughput benchmark. Run with `cargo test --release -- --ignored --nocapture bench_chunker_threads`
+    #[test]
+    #[ignore]
+    fn bench_chunker_threads() {
+        let secret = Secret::new();
+        let size = 1024 * 1024 * 1024;
+        let tempf = make_test_file(size);
+
+        for threads in [1, 2, 4, 8, 16, 32] {
+            let started = Instant::now();
+            let chunks = Chunker::new(tempf.path(), &secret, threads, ReadStrategy::Buffered)
+                .unwrap()
+                .count();
+            let elapsed = started.elapsed().as_secs_f64();
+            println!(
+                "threads: {threads:2} chunks: {chunks} throughput: {:.3} GB/s",
+                size as f64 / elapsed / 1e9
+            );
+        }
+    }
+
+    /// Compares read strategies. Page cache is not flushed between runs, so for cold cache numbers drop caches
+    /// manually and run one strategy at a time. Run with
+    /// `cargo test --release -- --ignored --nocapture bench_read_strategies`
+    #[test]
+    #[ignore]
+    fn bench_read_strategies() {
+        let secret = Secret::new();
+        let size = 1024 * 1024 * 1024;
+        let tempf = make_test_file(size);
+
+        for strategy in [
+            ReadStrategy::Buffered,
+            ReadStrategy::LargeBuffer,
+            ReadStrategy::DropCache,
+        ] {
+            for threads in [1, 8] {
+                let started = Instant::now();
+                let chunks = Chunker::new(tempf.path(), &secret, threads, strategy)
+                    .unwrap()
+                    .count();
+                let elapsed = started.elapsed().as_secs_f64();
+                println!(
+                    "strategy: {:12} threads: {threads:2} chunks: {chunks} throughput: {:.3} GB/s",
+                    format!("{:?}", strategy),
+                    size as f64 / elapsed / 1e9
+                );
+            }
+        }
+    }
+}
@@ -0,0 +1,175 @@
+use std::fs;
+use std::io;
+use std::io::{BufReader, Read};
+use std::path::Path;
+
+#[cfg(target_os = "linux")]
+use std::os::unix::io::AsRawFd;
+
+/// Size of the read buffer for every strategy except `Buffered`.
+pub const LARGE_BUFFER_SIZE: usize = 4 * 1024 * 1024;
+
+/// Pages are dropped from the page cache in windows of this size.
+#[cfg(target_os = "linux")]
+const DROP_CACHE_WINDOW: u64 = 16 * 1024 * 1024;
+
+/// How the indexer reads file contents.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum ReadStrategy {
+    /// Default-sized buffered reads. Page cache and readahead are left to the kernel.
+    Buffered,
+    /// Large buffered reads with a sequential access hint. Fewer syscalls on fast storage.
+    LargeBuffer,
+    /// Large buffered reads, already consumed pages are dropped from the page cache, so indexing does not evict data
+    /// of other processes. Linux only, elsewhere works as `LargeBuffer`.
+    DropCache,
+}
+
+/// Reader, that evicts pages from the page cache after they are read. By that time the data is already copied into
+/// the chunk buffer, so the pages are not needed anymore.
+#[cfg(target_os = "linux")]
+pub struct DropCacheSource {
+    f: fs::File,
+    pos: u64,
+    dropped_until: u64,
+}
+
+#[cfg(target_os = "linux")]
+impl DropCacheSource {
+    fn drop_cache(&mut self) {
+        let len = self.pos - self.dropped_until;
+        unsafe {
+            libc::posix_fadvise(
+                self.f.as_raw_fd(),
+                self.dropped_until as libc::off_t,
+                len as libc::off_t,
+                libc::POSIX_FADV_DONTNEED,
+            );
+        }
+        self.dropped_until = self.pos;
+    }
+}
+
+#[cfg(target_os = "linux")]
+impl Read for DropCacheSource {
+    fn read(&mut self, buf: &mut [u8]) -> io::Result<usize> {
+        let n = self.f.read(buf)?;
+        self.pos += n as u64;
+        if self.pos - self.dropped_until >= DROP_CACHE_WINDOW
+            || (n == 0 && self.pos > self.dropped_until)
+        {
+            self.drop_cache();
+        }
+        Ok(n)
+    }
+}
+
+#[cfg(target_os = "linux")]
+impl Drop for DropCacheSource {
+    fn drop(&mut self) {
+        if self.pos > self.dropped_until {
+            self.drop_cache();
+        }
+    }
+}
+
+pub enum Source {
+    File(fs::File),
+    #[cfg(target_os = "linux")]
+    DropCache(DropCacheSource),
+}
+
+impl Read for Source {
+    fn read(&mut self, buf: &mut [u8]) -> io::Result<usize> {
+        match self {
+            Source::File(f) => f.read(buf),
+            #[cfg(target_os = "linux")]
+            Source::DropCache(d) => d.read(buf),
+        }
+    }
+}
+
+pub type FileReader = BufReader<Source>;
+
+#[cfg(target_os = "linux")]
+fn advise_sequential(f: &fs::File) {
+    unsafe {
+        libc::posix_fadvise(f.as_raw_fd(), 0, 0, libc::POSIX_FADV_SEQUENTIAL);
+    }
+}
+
+// posix_fadvise is Linux-only, elsewhere readahead is left to the kernel
+#[cfg(not(target_os = "linux"))]
+fn advise_sequential(_f: &fs::File) {}
+
+/// Opens the file for indexing. Returns the reader and the file size.
+pub fn open(path: &Path, strategy: ReadStrategy) -> io::Result<(FileReader, u64)> {
+    let f = fs::File::open(path)?;
+    let size = f.metadata()?.len();
+
+    let reader = match strategy {
+        ReadStrategy::Buffered => BufReader::new(Source::File(f)),
+        ReadStrategy::LargeBuffer => {
+            advise_sequential(&f);
+            BufReader::with_capacity(LARGE_BUFFER_SIZE, Source::File(f))
+        }
+        #[cfg(target_os = "linux")]
+        ReadStrategy::DropCache => {
+            advise_sequential(&f);
+            BufReader::with_capacity(
+                LARGE_BUFFER_SIZE,
+                Source::DropCache(DropCacheSource {
+                    f,
+                    pos: 0,
+                    dropped_until: 0,
+                }),
+            )
+        }
+        // Strategies, not supported on this platform
+        #[allow(unreachable_patterns)]
+        _ => BufReader::with_capacity(LARGE_BUFFER_SIZE, Source::File(f)),
+    };
+
+    Ok((reader, size))
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::io::Write;
+
+    const ALL_STRATEGIES: [ReadStrategy; 3] = [
+        ReadStrategy::Buffered,
+        ReadStrategy::LargeBuffer,
+        ReadStrategy::DropCache,
+    ];
+
+    #[test]
+    fn test_strategies_read_same_data() {
+        let data: Vec<u8> = (0..LARGE_BUFFER_SIZE * 2 + 12345)
+            .map(|i| (i * 7) as u8)
+            .collect();
+        let mut tempf = tempfile::NamedTempFile::new().unwrap();
+        tempf.write_all(&data).unwrap();
+
+        for strategy in ALL_STRATEGIES {
+            let (mut reader, size) = open(tempf.path(), strategy).unwrap();
+            let mut read_data = vec![];
+            reader.read_to_end(&mut read_data).unwrap();
+            assert_eq!(size, data.len() as u64);
+            assert!(read_data == data, "{:?} returned different data", strategy);
+        }
+    }
+
+    #[test]
+    fn test_empty_file() {
+        let tempf = tempfile::NamedTempFile::new().unwrap();
+        for strategy in ALL_STRATEGIES {
+            let (mut reader, size) = open(tempf.path(), strategy).unwrap();
+            let mut read_data = vec![];
+            reader.read_to_end(&mut read_data).unwrap();
+            assert_eq!(size, 0);
+            assert!(read_data.is_empty());
+        }
+    }
+}
@@ -1,36 +1,62 @@
 use std::fmt::{Display, Formatter};
 use std::path::Path;
-use std::sync::Mutex;
+use std::sync::atomic::{AtomicU64, AtomicUsize, Ordering};
+use std::sync::{Mutex, MutexGuard, TryLockError};
+use std::time::Instant;
 
 use crate::indexer::proto;
-use log::{debug, trace};
+use log::{debug, trace, warn};
 use prost::Message;
-use rusqlite::{named_params, Connection, Params, Result};
-use serde::Serializer;
-use serde::{Deserialize, Deserializer, Serialize};
+use rusqlite::{named_params, Connection, OpenFlags, Params, Result};
 
+/// One connection for writes and a pool of connections for reads. In WAL mode, readers see the last commit and are
+/// not blocked by the writer, so only readers, that got the same connection, wait for each other.
 pub struct Index {
-    conn: Mutex<Connection>,
+    writer: Mutex<Connection>,
+    readers: Vec<Mutex<Connection>>,
+    next_reader: AtomicUsize,
+    writer_stats: LockStats,
+    reader_stats: LockStats,
 }
 
-fn as_base64<S: Serializer>(v: &Vec<u8>, s: S) -> rusqlite::Result<S::Ok, S::Error> {
-    s.serialize_str(&base64::encode(v))
+#[derive(Default)]
+struct LockStats {
+    acquisitions: AtomicU64,
+    contended: AtomicU64,
+    wait_ns: AtomicU64,
 }
 
-pub fn from_base64<'de, D>(deserializer: D) -> rusqlite::Result<Vec<u8>, D::Error>
-where
-    D: Deserializer<'de>,
-{
-    use serde::de::Error;
-    String::deserialize(deserializer)
-        .and_then(|string| base64::decode(&string).map_err(|err| Error::custom(err.to_string())))
+impl LockStats {
+    fn lock<'a>(&self, conn: &'a Mutex<Connection>) -> MutexGuard<'a, Connection> {
+        self.acquisitions.fetch_add(1, Ordering::Relaxed);
+        match conn.try_lock() {
+            Ok(guard) => guard,
+            Err(TryLockError::WouldBlock) => self.wait(conn),
+            Err(TryLockError::Poisoned(e)) => panic!("{}", e),
+        }
+    }
+
+    fn wait<'a>(&self, conn: &'a Mutex<Connection>) -> MutexGuard<'a, Connection> {
+        self.contended.fetch_add(1, Ordering::Relaxed);
+        let started = Instant::now();
+        let guard = conn.lock().unwrap();
+        self.wait_ns
+            .fetch_add(started.elapsed().as_nanos() as u64, Ordering::Relaxed);
+        guard
+    }
+
+    fn snapshot(&self) -> ffx::LockStats {
+        ffx::LockStats {
+            acquisitions: self.acquisitions.load(Ordering::Relaxed),
+            contended: self.contended.load(Ordering::Relaxed),
+            wait_ns: self.wait_ns.load(Ordering::Relaxed),
+        }
+    }
 }
 
-#[derive(Serialize, Deserialize, Clone, Debug)]
+#[derive(Clone, Debug)]
 pub struct SignedMeta {
-    #[serde(serialize_with = "as_base64", deserialize_with = "from_base64")]
     pub meta: Vec<u8>,
-    #[serde(serialize_with = "as_base64", deserialize_with = "from_base64")]
     pub signature: Vec<u8>,
 }
 
@@ -40,14 +66,19 @@ impl SignedMeta {
     }
 }
 
-#[derive(Serialize)]
-struct Output {
-    metas: Vec<SignedMeta>,
+impl From<SignedMeta> for ffx::SignedMetaRecord {
+    fn from(signed_meta: SignedMeta) -> Self {
+        ffx::SignedMetaRecord {
+            meta: signed_meta.meta,
+            signature: signed_meta.signature,
+        }
+    }
 }
 
 #[derive(Debug)]
 pub enum IndexError {
     SqlError(rusqlite::Error),
+    DecodeError(prost::DecodeError),
     MetaNotFound,
 }
 
@@ -57,6 +88,12 @@ impl From<rusqlite::Error> for IndexError {
     }
 }
 
+impl From<prost::DecodeError> for IndexError {
+    fn from(err: prost::DecodeError) -> IndexError {
+        IndexError::DecodeError(err)
+    }
+}
+
 impl Display for IndexError {
     fn fmt(&self, f: &mut Formatter<'_>) -> std::fmt::Result {
         write!(f, "{:?}", self)
@@ -64,18 +101,74 @@ impl Display for IndexError {
 }
 
 impl Index {
-    pub fn new<P: AsRef<Path>>(db_path: P) -> Self {
+    /// `synchronous` is the SQLite synchronous level: "off", "normal", "full" or "extra"
+    pub fn new<P: AsRef<Path>>(db_path: P, synchronous: &str, readers: usize) -> Self {
         debug!("Opening database: {:?}", db_path.as_ref());
         let conn = Connection::open(db_path.as_ref()).unwrap();
+
+        // In WAL mode, readers are not blocked by the writer, and a commit is a sequential append to the log
+        let journal_mode: String = conn
+            .query_row("PRAGMA journal_mode=WAL;", [], |row| row.get(0))
+            .unwrap();
+        let synchronous = match synchronous.to_ascii_lowercase().as_str() {
+            level @ ("off" | "normal" | "full" | "extra") => level.to_owned(),
+            level => {
+                warn!("Unknown synchronous level: {:?}, using \"normal\"", level);
+                "normal".to_owned()
+            }
+        };
+        conn.execute_batch(&format!("PRAGMA synchronous={};", synchronous))
+            .unwrap();
+        debug!(
+            "Journal mode: {}, synchronous: {}",
+            journal_mode, synchronous
+        );
+
+        // Connections are never shared between threads without the mutex, so SQLite's own locking is not needed
+        let readers = (0..readers.max(1))
+            .map(|_| {
+                let reader = Connection::open_with_flags(
+                    db_path.as_ref(),
+                    OpenFlags::SQLITE_OPEN_READ_WRITE | OpenFlags::SQLITE_OPEN_NO_MUTEX,
+                )
+                .unwrap();
+                reader.execute_batch("PRAGMA query_only=1;").unwrap();
+                Mutex::new(reader)
+            })
+            .collect();
+
         Index {
-            conn: Mutex::new(conn),
+            writer: Mutex::new(conn),
+            readers,
+            next_reader: AtomicUsize::new(0),
+            writer_stats: LockStats::default(),
+            reader_stats: LockStats::default(),
+        }
+    }
+
+    fn writer(&self) -> MutexGuard<Connection> {
+        self.writer_stats.lock(&self.writer)
+    }
+
+    /// Takes a free reader connection. If all of them are busy, waits for the next one in turn.
+    fn reader(&self) -> MutexGuard<Connection> {
+        self.reader_stats
+            .acquisitions
+            .fetch_add(1, Ordering::Relaxed);
+        let first = self.next_reader.fetch_add(1, Ordering::Relaxed);
+        for i in 0..self.readers.len() {
+            if let Ok(guard) = self.readers[(first + i) % self.readers.len()].try_lock() {
+                return guard;
+            }
         }
+        self.reader_stats
+            .wait(&self.readers[first % self.readers.len()])
     }
 
     pub fn migrate(&self) -> rusqlite::Result<usize> {
         debug!("Starting database migration");
 
-        let conn = self.conn.lock().unwrap();
+        let conn = self.writer();
 
         // Invoke migrations. Potentially destructive!
         (*conn).execute("PRAGMA foreign_keys = ON;", [])?;
@@ -113,9 +206,9 @@ impl Index {
         query: &str,
         params: P,
     ) -> Result<Vec<SignedMeta>, IndexError> {
-        let conn = self.conn.lock().unwrap();
+        let conn = self.reader();
 
-        let mut meta_stmt = (*conn).prepare(query).unwrap(); // If sql is invalid, panic!
+        let mut meta_stmt = (*conn).prepare_cached(query).unwrap(); // If sql is invalid, panic!
         let meta_iter = meta_stmt
             .query_map(params, |row| {
                 Ok(SignedMeta {
@@ -139,23 +232,66 @@ impl Index {
         .ok_or(IndexError::MetaNotFound)
     }
 
-    pub fn get_meta_all(&self) -> Result<Vec<SignedMeta>, IndexError> {
-        self.get_signed_meta("SELECT meta, signature FROM meta", [])
-    }
+    /// Reads up to `limit` Metas with path_id greater than `after_path_id`, ordered by path_id. Pass the last path_id of
+    /// the batch to get the next one, so the whole index is never loaded at once.
+    pub fn get_meta_batch(
+        &self,
+        filter: ffx::MetaFilter,
+        after_path_id: &[u8],
+        limit: u32,
+    ) -> Result<ffx::MetaBatch, IndexError> {
+        let condition = match filter {
+            ffx::MetaFilter::Assembled => "(type<>0)=1 AND assembled=1",
+            ffx::MetaFilter::Incomplete => "(type<>0)=1 AND assembled=0",
+            _ => "1",
+        };
+        let query = format!(
+            "SELECT path_id, meta, signature FROM meta WHERE path_id>:after_path_id AND {} ORDER BY path_id LIMIT :limit",
+            condition
+        );
 
-    fn get_meta_assembled(&self, assembled: bool) -> Result<Vec<SignedMeta>, IndexError> {
-        self.get_signed_meta(
-            "SELECT meta, signature FROM meta WHERE (type<>0)=1 AND assembled=:assembled",
-            named_params! {":assembled": assembled},
-        )
+        let conn = self.reader();
+        let mut meta_stmt = (*conn).prepare_cached(&query)?;
+        let mut rows =
+            meta_stmt.query(named_params! {":after_path_id": after_path_id, ":limit": limit})?;
+
+        let mut batch = ffx::MetaBatch {
+            records: vec![],
+            last_path_id: vec![],
+        };
+        while let Some(row) = rows.next()? {
+            batch.last_path_id = row.get(0)?;
+            batch.records.push(ffx::SignedMetaRecord {
+                meta: row.get(1)?,
+                signature: row.get(2)?,
+            });
+        }
+        Ok(batch)
     }
 
     fn get_meta_with_chunk(&self, chunk_id: &[u8]) -> Result<Vec<SignedMeta>, IndexError> {
         self.get_signed_meta("SELECT meta.meta, meta.signature FROM meta JOIN openfs ON meta.path_id=openfs.path_id WHERE openfs.ct_hash=:chunk_id", named_params!{":chunk_id": chunk_id})
     }
 
+    /// Reads a compact summary of every Meta, without returning Meta bodies and signatures
+    pub fn get_meta_summaries(&self) -> Result<Vec<ffx::MetaSummary>, IndexError> {
+        let conn = self.reader();
+
+        let mut meta_stmt = (*conn).prepare("SELECT meta FROM meta")?;
+        let meta_iter = meta_stmt.query_map([], |row| row.get::<_, Vec<u8>>(0))?;
+
+        let mut summaries = vec![];
+        for meta in meta_iter {
+            match proto::Meta::decode(&*meta?) {
+                Ok(meta) => summaries.push(summarize_meta(&meta)),
+                Err(e) => warn!("Skipping undecodable Meta: {}", e),
+            }
+        }
+        Ok(summaries)
+    }
+
     fn set_assembled(&self, meta_id: &[u8]) -> Result<(), IndexError> {
-        let mut conn = self.conn.lock().unwrap();
+        let mut conn = self.writer();
         let mut tx = (*conn).transaction()?;
 
         {
@@ -175,7 +311,7 @@ impl Index {
     }
 
     fn wipe(&self) -> Result<(), IndexError> {
-        let mut conn = self.conn.lock().unwrap();
+        let mut conn = self.writer();
         let mut tx = (*conn).transaction()?;
 
         {
@@ -190,85 +326,182 @@ impl Index {
     }
 
     fn is_chunk_assembled(&self, chunk_id: &[u8]) -> Result<bool, IndexError> {
-        let conn = self.conn.lock().unwrap();
-        let mut meta_stmt = (*conn).prepare(
+        let conn = self.reader();
+        let mut meta_stmt = (*conn).prepare_cached(
             "SELECT assembled FROM openfs WHERE ct_hash=:chunk_id AND openfs.assembled=1 LIMIT 1",
         )?;
         Ok(meta_stmt.exists(named_params! {":chunk_id": chunk_id})?)
     }
 
-    pub fn put_meta(&self, meta: &SignedMeta, fully_assembled: bool) -> Result<(), IndexError> {
-        let de_meta = proto::Meta::decode(&*meta.meta).unwrap();
+    fn get_chunk_size_iv(&self, ct_hash: &[u8]) -> Result<ffx::ChunkSizeIv, IndexError> {
+        let conn = self.reader();
+        let mut chunk_stmt =
+            (*conn).prepare_cached("SELECT size, iv FROM chunk WHERE ct_hash=:ct_hash")?;
+        let mut rows = chunk_stmt.query(named_params! {":ct_hash": ct_hash})?;
+        match rows.next()? {
+            Some(row) => Ok(ffx::ChunkSizeIv {
+                size: row.get(0)?,
+                iv: row.get(1)?,
+            }),
+            None => Err(IndexError::MetaNotFound),
+        }
+    }
 
-        let mut conn = self.conn.lock().unwrap();
-        let mut tx = (*conn).transaction()?;
+    pub fn put_meta(&self, meta: &SignedMeta, fully_assembled: bool) -> Result<(), IndexError> {
+        match self
+            .put_metas(&[(
+                meta.meta.as_slice(),
+                meta.signature.as_slice(),
+                fully_assembled,
+            )])?
+            .pop()
         {
-            let sp = tx.savepoint()?;
+            Some((_, e)) => Err(e),
+            None => Ok(()),
+        }
+    }
 
-            let _ = sp.execute(
-                "INSERT OR REPLACE INTO meta (path_id, meta, signature, type, assembled) VALUES (:path_id, :meta, :signature, :type, :assembled);", named_params! {
-                ":path_id": de_meta.path_id,
-                ":meta": meta.meta,
-                ":signature": meta.signature,
-                ":type": de_meta.meta_type,
-                ":assembled": fully_assembled
-            })?;
-
-            if de_meta.type_specific_metadata.is_some() {
-                if let proto::meta::TypeSpecificMetadata::FileMetadata(tsm) =
-                    de_meta.type_specific_metadata.unwrap()
-                {
-                    trace!("Putting {} chunks", tsm.chunks.len());
-                    let mut offset = 0;
-                    for chunk in tsm.chunks {
-                        sp.execute(
-                            "INSERT OR IGNORE INTO chunk (ct_hash, size, iv) VALUES (:ct_hash, :size, :iv);", named_params! {":ct_hash": chunk.ct_hash, ":size": chunk.size, ":iv": chunk.iv}
-                        )?;
-                        sp.execute(
-                            "INSERT OR REPLACE INTO openfs (ct_hash, path_id, [offset], assembled) VALUES (:ct_hash, :path_id, :offset, :assembled);", named_params! {":ct_hash": chunk.ct_hash, ":path_id": de_meta.path_id, ":offset": offset, ":assembled": fully_assembled}
-                        )?;
-                        offset += chunk.size;
-                    }
+    /// Puts all Metas in a single transaction, so the commit cost is shared between them. A Meta, that can't be decoded,
+    /// is skipped, and the rest are committed. Returns indices of skipped Metas with their errors.
+    fn put_metas(
+        &self,
+        metas: &[(&[u8], &[u8], bool)],
+    ) -> Result<Vec<(usize, IndexError)>, IndexError> {
+        let mut conn = self.writer();
+        let tx = (*conn).transaction()?;
+        let mut rejected = vec![];
+        for (i, (meta, signature, fully_assembled)) in metas.iter().enumerate() {
+            match insert_meta(&tx, meta, signature, *fully_assembled) {
+                Err(IndexError::DecodeError(e)) => {
+                    warn!("Skipping undecodable Meta: {}", e);
+                    rejected.push((i, IndexError::DecodeError(e)));
                 }
+                result => result?,
             }
-            sp.commit()?;
         }
         tx.commit()?;
 
-        debug!(
-            "Added Meta of {}, t: {:?}, a: {}",
-            hex::encode(de_meta.path_id),
-            de_meta.meta_type,
-            fully_assembled
+        trace!(
+            "Committed {} Metas, skipped {}",
+            metas.len() - rejected.len(),
+            rejected.len()
         );
-        Ok(())
+        Ok(rejected)
     }
 }
 
-fn wrap_result_single(meta: SignedMeta) -> Vec<u8> {
-    serde_json::to_vec(&Output { metas: vec![meta] }).unwrap()
+fn insert_meta(
+    conn: &Connection,
+    meta: &[u8],
+    signature: &[u8],
+    fully_assembled: bool,
+) -> Result<(), IndexError> {
+    // Decoded before anything is written, so a malformed Meta leaves the transaction intact
+    let de_meta = proto::Meta::decode(meta)?;
+
+    conn.prepare_cached(
+        "INSERT OR REPLACE INTO meta (path_id, meta, signature, type, assembled) VALUES (:path_id, :meta, :signature, :type, :assembled);",
+    )?
+    .execute(named_params! {
+        ":path_id": de_meta.path_id,
+        ":meta": meta,
+        ":signature": signature,
+        ":type": de_meta.meta_type,
+        ":assembled": fully_assembled
+    })?;
+
+    if let Some(proto::meta::TypeSpecificMetadata::FileMetadata(tsm)) =
+        &de_meta.type_specific_metadata
+    {
+        trace!("Putting {} chunks", tsm.chunks.len());
+        let mut chunk_stmt = conn.prepare_cached(
+            "INSERT OR IGNORE INTO chunk (ct_hash, size, iv) VALUES (:ct_hash, :size, :iv);",
+        )?;
+        let mut openfs_stmt = conn.prepare_cached(
+            "INSERT OR REPLACE INTO openfs (ct_hash, path_id, [offset], assembled) VALUES (:ct_hash, :path_id, :offset, :assembled);",
+        )?;
+        let mut offset = 0;
+        for chunk in &tsm.chunks {
+            chunk_stmt.execute(
+                named_params! {":ct_hash": chunk.ct_hash, ":size": chunk.size, ":iv": chunk.iv},
+            )?;
+            openfs_stmt.execute(named_params! {":ct_hash": chunk.ct_hash, ":path_id": de_meta.path_id, ":offset": offset, ":assembled": fully_assembled})?;
+            offset += chunk.size;
+        }
+    }
+
+    debug!(
+        "Added Meta of {}, t: {:?}, a: {}",
+        hex::encode(&de_meta.path_id),
+        de_meta.meta_type,
+        fully_assembled
+    );
+    Ok(())
+}
+
+fn summarize_meta(meta: &proto::Meta) -> ffx::MetaSummary {
+    let size = match &meta.type_specific_metadata {
+        Some(proto::meta::TypeSpecificMetadata::FileMetadata(tsm)) => {
+            tsm.chunks.iter().map(|chunk| chunk.size as u64).sum()
+        }
+        _ => 0,
+    };
+
+    ffx::MetaSummary {
+        path_id: meta.path_id.clone(),
+        revision: meta.revision,
+        mtime: meta
+            .generic_metadata
+            .as_ref()
+            .map(|generic_metadata| generic_metadata.mtime)
+            .unwrap_or(0),
+        size,
+        meta_type: meta.meta_type,
+    }
 }
 
-fn wrap_result_multi(metas: Vec<SignedMeta>) -> Vec<u8> {
-    serde_json::to_vec(&Output { metas }).unwrap()
+/// Meta bodies and signatures are moved to C++ as they are, without intermediate encoding
+fn to_records(metas: Vec<SignedMeta>) -> Vec<ffx::SignedMetaRecord> {
+    metas.into_iter().map(ffx::SignedMetaRecord::from).collect()
 }
 
 impl Index {
-    fn c_get_meta_by_path_id(&self, path_id: &[u8]) -> Result<Vec<u8>, IndexError> {
-        let meta = self.get_meta_by_path_id(path_id)?;
-        Ok(wrap_result_single(meta))
+    fn c_get_meta_by_path_id(
+        &self,
+        path_id: &[u8],
+    ) -> Result<Vec<ffx::SignedMetaRecord>, IndexError> {
+        Ok(to_records(vec![self.get_meta_by_path_id(path_id)?]))
     }
 
-    fn c_get_meta_all(&self) -> Result<Vec<u8>, IndexError> {
-        Ok(wrap_result_multi(self.get_meta_all()?))
+    fn c_get_meta_batch(
+        &self,
+        filter: ffx::MetaFilter,
+        after_path_id: &[u8],
+        limit: u32,
+    ) -> Result<ffx::MetaBatch, IndexError> {
+        self.get_meta_batch(filter, after_path_id, limit)
+    }
+
+    fn c_get_meta_with_chunk(
+        &self,
+        chunk_id: &[u8],
+    ) -> Result<Vec<ffx::SignedMetaRecord>, IndexError> {
+        Ok(to_records(self.get_meta_with_chunk(chunk_id)?))
     }
 
-    fn c_get_meta_assembled(&self, assembled: bool) -> Result<Vec<u8>, IndexError> {
-        Ok(wrap_result_multi(self.get_meta_assembled(assembled)?))
+    fn c_get_meta_summaries(&self) -> Result<Vec<ffx::MetaSummary>, IndexError> {
+        self.get_meta_summaries()
     }
 
-    fn c_get_meta_with_chunk(&self, chunk_id: &[u8]) -> Result<Vec<u8>, IndexError> {
-        Ok(wrap_result_multi(self.get_meta_with_chunk(chunk_id)?))
+    fn c_get_chunk_size_iv(&self, ct_hash: &[u8]) -> Result<ffx::ChunkSizeIv, IndexError> {
+        self.get_chunk_size_iv(ct_hash)
+    }
+
+    fn c_lock_stats(&self) -> ffx::IndexLockStats {
+        ffx::IndexLockStats {
+            writer: self.writer_stats.snapshot(),
+            readers: self.reader_stats.snapshot(),
+        }
     }
 
     fn c_migrate(&self) -> Result<(), IndexError> {
@@ -276,28 +509,100 @@ impl Index {
         Ok(())
     }
 
-    fn c_put_meta(&self, signed_meta: &str, fully_assembled: bool) -> Result<(), IndexError> {
-        self.put_meta(&serde_json::from_str(signed_meta).unwrap(), fully_assembled)
+    fn c_put_meta_batch(&self, records: &[ffx::PutMetaRecord]) -> Result<Vec<u32>, IndexError> {
+        let metas: Vec<_> = records
+            .iter()
+            .map(|record| {
+                (
+                    record.meta.as_slice(),
+                    record.signature.as_slice(),
+                    record.fully_assembled,
+                )
+            })
+            .collect();
+        Ok(self
+            .put_metas(&metas)?
+            .into_iter()
+            .map(|(i, _)| i as u32)
+            .collect())
     }
 }
 
-fn index_new(db_path: &str) -> Box<Index> {
-    Box::new(Index::new(Path::new(db_path)))
+fn index_new(db_path: &str, synchronous: &str, readers: u32) -> Box<Index> {
+    Box::new(Index::new(
+        Path::new(db_path),
+        synchronous,
+        readers as usize,
+    ))
 }
 
 #[cxx::bridge(namespace = "librevault::bridge")]
 mod ffx {
+    struct MetaSummary {
+        path_id: Vec<u8>,
+        revision: i64,
+        mtime: i64,
+        size: u64,
+        meta_type: u32,
+    }
+
+    struct SignedMetaRecord {
+        meta: Vec<u8>,
+        signature: Vec<u8>,
+    }
+
+    struct PutMetaRecord {
+        meta: Vec<u8>,
+        signature: Vec<u8>,
+        fully_assembled: bool,
+    }
+
+    struct ChunkSizeIv {
+        size: u32,
+        iv: Vec<u8>,
+    }
+
+    struct LockStats {
+        acquisitions: u64,
+        contended: u64, // Acquisitions, that had to wait
+        wait_ns: u64,
+    }
+
+    struct IndexLockStats {
+        writer: LockStats,
+        readers: LockStats,
+    }
+
+    enum MetaFilter {
+        All,
+        Assembled,
+        Incomplete,
+    }
+
+    struct MetaBatch {
+        records: Vec<SignedMetaRecord>,
+        last_path_id: Vec<u8>, // Cursor for the next batch. Empty if the batch is empty.
+    }
+
     extern "Rust" {
         type Index;
-        fn index_new(db_path: &str) -> Box<Index>;
+        fn index_new(db_path: &str, synchronous: &str, readers: u32) -> Box<Index>;
         fn c_migrate(self: &Index) -> Result<()>;
-        fn c_get_meta_by_path_id(self: &Index, path_id: &[u8]) -> Result<Vec<u8>>;
-        fn c_get_meta_all(self: &Index) -> Result<Vec<u8>>;
-        fn c_get_meta_assembled(self: &Index, assembled: bool) -> Result<Vec<u8>>;
-        fn c_get_meta_with_chunk(self: &Index, chunk_id: &[u8]) -> Result<Vec<u8>>;
+        fn c_get_meta_by_path_id(self: &Index, path_id: &[u8]) -> Result<Vec<SignedMetaRecord>>;
+        fn c_get_meta_batch(
+            self: &Index,
+            filter: MetaFilter,
+            after_path_id: &[u8],
+            limit: u32,
+        ) -> Result<MetaBatch>;
+        fn c_get_meta_with_chunk(self: &Index, chunk_id: &[u8]) -> Result<Vec<SignedMetaRecord>>;
+        fn c_get_meta_summaries(self: &Index) -> Result<Vec<MetaSummary>>;
         fn set_assembled(self: &Index, meta_id: &[u8]) -> Result<()>;
         fn wipe(self: &Index) -> Result<()>;
         fn is_chunk_assembled(self: &Index, chunk_id: &[u8]) -> Result<bool>;
-        fn c_put_meta(&self, signed_meta: &str, fully_assembled: bool) -> Result<()>;
+        fn c_get_chunk_size_iv(self: &Index, ct_hash: &[u8]) -> Result<ChunkSizeIv>;
+        fn c_lock_stats(self: &Index) -> IndexLockStats;
+        /// Returns indices of records, that were skipped as undecodable
+        fn c_put_meta_batch(self: &Index, records: &[PutMetaRecord]) -> Result<Vec<u32>>;
     }
 }
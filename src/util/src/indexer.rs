@@ -1,29 +1,28 @@
 use crate::aescbc::encrypt_aes256;
-use crate::aescbc::encrypt_chunk;
+use crate::chunker::{kmac_sha3_224, Chunker};
+use crate::file_reader::ReadStrategy;
 use crate::index::SignedMeta;
 use crate::path_normalize::normalize;
 use crate::secret::Secret;
-use log::{debug, trace};
+use log::trace;
 use num_derive::FromPrimitive;
 use num_traits::FromPrimitive;
 use prost::Message;
-use rabin::{Rabin, RabinParams};
 use rand::{thread_rng, Fill};
-use sha3::digest::Update;
-use sha3::{Digest, Sha3_224};
 use std::fmt::{Display, Formatter};
 use std::fs;
 use std::io;
-use std::io::{BufReader, ErrorKind, Read};
+use std::io::ErrorKind;
 use std::path::Path;
 use std::str::FromStr;
+use std::sync::atomic::Ordering;
 use std::time::SystemTime;
 
 pub mod proto {
     include!(concat!(env!("OUT_DIR"), "/librevault.serialization.rs"));
 }
 
-type Chunk = proto::meta::file_metadata::Chunk;
+pub(crate) type Chunk = proto::meta::file_metadata::Chunk;
 
 #[derive(FromPrimitive)]
 enum ObjectType {
@@ -51,41 +50,9 @@ impl Display for IndexingError {
     }
 }
 
-fn kmac_sha3_224(key: &[u8], data: &[u8]) -> Vec<u8> {
-    let mut hasher = Sha3_224::new();
-    Update::update(&mut hasher, key);
-    Update::update(&mut hasher, data);
-    hasher.finalize().to_vec()
-}
-
-fn populate_chunk(data: &[u8], secret: &Secret) -> Chunk {
-    debug!("New chunk size: {}", data.len());
-
-    let mut iv = vec![0u8; 16];
-    iv.try_fill(&mut thread_rng()).unwrap();
-
-    let symmetric_key = secret.get_symmetric_key().unwrap();
-
-    proto::meta::file_metadata::Chunk {
-        ct_hash: Sha3_224::digest(&*encrypt_chunk(data, symmetric_key, &*iv)).to_vec(),
-        iv,
-        size: data.len() as u32,
-        pt_hmac: kmac_sha3_224(symmetric_key, data),
-    }
-}
-
-fn make_chunks_for_buf<R: Read>(reader: R, secret: &Secret) -> Result<Vec<Chunk>, IndexingError> {
-    Rabin::new(reader, RabinParams::default())
-        .map(|chunk| Ok(populate_chunk(chunk?.as_slice(), secret)))
-        .collect()
-}
-
 fn make_chunks(path: &Path, secret: &Secret) -> Result<Vec<Chunk>, IndexingError> {
-    trace!("Trying to make chunks for: {:?}", path);
-
-    let f = fs::File::open(path)?;
-    let reader = BufReader::new(f);
-    let chunks = make_chunks_for_buf(reader, secret)?;
+    let chunks = Chunker::new(path, secret, 1, ReadStrategy::Buffered)?
+        .collect::<Result<Vec<Chunk>, IndexingError>>()?;
 
     trace!("Total chunks for path {:?}: {}", path, chunks.len());
 
@@ -224,22 +191,201 @@ pub fn sign_meta(meta: &proto::Meta, secret: &Secret) -> SignedMeta {
     }
 }
 
-fn c_make_chunks(path: &str, secret: &str) -> Result<Vec<u8>, IndexingError> {
-    let chunks = make_chunks(Path::new(path), &Secret::from_str(secret).unwrap())?;
-    let chunks: Vec<String> = chunks
-        .into_iter()
-        .map(|chunk| base64::encode(chunk.encode_to_vec()))
-        .collect();
+fn chunker_new(
+    path: &str,
+    secret: &str,
+    threads: u32,
+    read_strategy: ffi::ReadStrategy,
+) -> Result<Box<Chunker>, IndexingError> {
+    let read_strategy = match read_strategy {
+        ffi::ReadStrategy::LargeBuffer => ReadStrategy::LargeBuffer,
+        ffi::ReadStrategy::DropCache => ReadStrategy::DropCache,
+        _ => ReadStrategy::Buffered,
+    };
+    Ok(Box::new(Chunker::new(
+        Path::new(path),
+        &Secret::from_str(secret).unwrap(),
+        threads as usize,
+        read_strategy,
+    )?))
+}
 
-    let j = serde_json::to_vec(&serde_json::Value::from(chunks)).unwrap();
-    trace!("Chunks_json: {}", String::from_utf8(j.clone()).unwrap());
+impl Chunker {
+    fn c_add_known_chunk(&mut self, ct_hash: &[u8], size: u32, iv: &[u8], pt_hmac: &[u8]) {
+        self.add_known_chunk(Chunk {
+            ct_hash: ct_hash.to_vec(),
+            iv: iv.to_vec(),
+            size,
+            pt_hmac: pt_hmac.to_vec(),
+        });
+    }
 
-    Ok(j)
+    fn c_stage_timings(&self) -> ffi::ChunkerTimings {
+        let timings = self.stage_timings();
+        ffi::ChunkerTimings {
+            read_ns: timings.read_ns.load(Ordering::Relaxed),
+            encrypt_ns: timings.encrypt_ns.load(Ordering::Relaxed),
+            hash_ns: timings.hash_ns.load(Ordering::Relaxed),
+        }
+    }
+
+    fn c_next_chunk(&mut self, record: &mut ffi::ChunkRecord) -> Result<bool, IndexingError> {
+        match self.next() {
+            Some(chunk) => {
+                let chunk = chunk?;
+                *record = ffi::ChunkRecord {
+                    ct_hash: chunk.ct_hash,
+                    size: chunk.size,
+                    iv: chunk.iv,
+                    pt_hmac: chunk.pt_hmac,
+                };
+                Ok(true)
+            }
+            None => Ok(false),
+        }
+    }
 }
 
 #[cxx::bridge]
 mod ffi {
+    struct ChunkRecord {
+        ct_hash: Vec<u8>,
+        size: u32,
+        iv: Vec<u8>,
+        pt_hmac: Vec<u8>,
+    }
+
+    struct ChunkerTimings {
+        read_ns: u64,
+        encrypt_ns: u64,
+        hash_ns: u64,
+    }
+
+    enum ReadStrategy {
+        Buffered,
+        LargeBuffer,
+        DropCache,
+    }
+
     extern "Rust" {
-        fn c_make_chunks(path: &str, secret: &str) -> Result<Vec<u8>>;
+        type Chunker;
+        fn chunker_new(
+            path: &str,
+            secret: &str,
+            threads: u32,
+            read_strategy: ReadStrategy,
+        ) -> Result<Box<Chunker>>;
+        fn c_add_known_chunk(
+            self: &mut Chunker,
+            ct_hash: &[u8],
+            size: u32,
+            iv: &[u8],
+            pt_hmac: &[u8],
+        );
+        fn c_next_chunk(self: &mut Chunker, record: &mut ChunkRecord) -> Result<bool>;
+        fn bytes_processed(self: &Chunker) -> u64;
+        fn chunks_reused(self: &Chunker) -> u64;
+        fn c_stage_timings(self: &Chunker) -> ChunkerTimings;
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::io::Write;
+
+    #[test]
+    fn test_chunk_records() {
+        let secret = Secret::new();
+        let mut tempf = tempfile::NamedTempFile::new().unwrap();
+        let data: Vec<u8> = (0..3 * 1024 * 1024).map(|i| (i * 31 % 251) as u8).collect();
+        tempf.write_all(&data).unwrap();
+
+        let mut chunker = chunker_new(
+            tempf.path().to_str().unwrap(),
+            &secret.to_string(),
+            1,
+            ffi::ReadStrategy::Buffered,
+        )
+        .unwrap();
+        let mut record = ffi::ChunkRecord {
+            ct_hash: vec![],
+            size: 0,
+            iv: vec![],
+            pt_hmac: vec![],
+        };
+        let mut total_size = 0;
+        while chunker.c_next_chunk(&mut record).unwrap() {
+            assert_eq!(record.iv.len(), 16);
+            assert_eq!(record.ct_hash.len(), 28);
+            assert_eq!(record.pt_hmac.len(), 28);
+            total_size += record.size as usize;
+            assert_eq!(chunker.bytes_processed(), total_size as u64);
+        }
+        assert_eq!(total_size, data.len());
+    }
+
+    #[test]
+    fn test_known_chunks_reused() {
+        let secret = Secret::new();
+        let mut tempf = tempfile::NamedTempFile::new().unwrap();
+        let data: Vec<u8> = (0..3 * 1024 * 1024).map(|i| (i * 31 % 251) as u8).collect();
+        tempf.write_all(&data).unwrap();
+
+        let old_chunks = make_chunks(tempf.path(), &secret).unwrap();
+
+        let mut chunker = Chunker::new(tempf.path(), &secret, 1, ReadStrategy::Buffered).unwrap();
+        for chunk in &old_chunks {
+            chunker.add_known_chunk(chunk.clone());
+        }
+        let new_chunks = chunker
+            .by_ref()
+            .collect::<Result<Vec<Chunk>, IndexingError>>()
+            .unwrap();
+
+        assert_eq!(new_chunks, old_chunks);
+        assert_eq!(chunker.chunks_reused(), old_chunks.len() as u64);
+    }
+
+    #[test]
+    fn test_changed_chunk_not_reused() {
+        let secret = Secret::new();
+        let mut old_file = tempfile::NamedTempFile::new().unwrap();
+        let mut state = 0x12345678u32;
+        let mut data: Vec<u8> = (0..16 * 1024 * 1024)
+            .map(|_| {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                state as u8
+            })
+            .collect();
+        old_file.write_all(&data).unwrap();
+
+        let old_chunks = make_chunks(old_file.path(), &secret).unwrap();
+
+        let mut new_file = tempfile::NamedTempFile::new().unwrap();
+        let middle = data.len() / 2;
+        data[middle] ^= 0xff;
+        new_file.write_all(&data).unwrap();
+
+        let mut chunker =
+            Chunker::new(new_file.path(), &secret, 1, ReadStrategy::Buffered).unwrap();
+        for chunk in &old_chunks {
+            chunker.add_known_chunk(chunk.clone());
+        }
+        let new_chunks = chunker
+            .by_ref()
+            .collect::<Result<Vec<Chunk>, IndexingError>>()
+            .unwrap();
+
+        // Boundaries are content-defined, so only the chunk with the changed byte is encrypted again (its neighbour too,
+        // if a boundary moved). Chunks before and after it are reused, but the chunk list is not the old one, so this is
+        // not a metadata-only revision.
+        assert!(chunker.chunks_reused() > 0);
+        assert!(chunker.chunks_reused() < new_chunks.len() as u64);
+        let ct_hashes =
+            |chunks: &[Chunk]| chunks.iter().map(|c| c.ct_hash.clone()).collect::<Vec<_>>();
+        assert_ne!(ct_hashes(&old_chunks), ct_hashes(&new_chunks));
     }
 }
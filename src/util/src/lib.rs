@@ -1,5 +1,7 @@
 pub mod aescbc;
+pub mod chunker;
 pub mod enc_storage;
+pub mod file_reader;
 pub mod index;
 pub mod indexer;
 mod logger;
@@ -68,25 +68,62 @@ pub fn denormalize(
     Ok(denormalized)
 }
 
-fn normalize_cxx(
-    path: &str,
-    root: &str,
+/// Normalizer bound to a folder root, so the root is converted once and not on every call.
+pub struct Normalizer {
+    root: PathBuf,
     normalize_unicode: bool,
-) -> Result<Vec<u8>, NormalizationError> {
-    normalize(Path::new(path), Path::new(root), normalize_unicode)
 }
 
-fn denormalize_cxx(path: &[u8], root: &str) -> Result<String, NormalizationError> {
-    Ok(String::from(
-        denormalize(path, Some(Path::new(root)))?.to_str().unwrap(),
-    ))
+impl Normalizer {
+    pub fn new(root: impl Into<PathBuf>, normalize_unicode: bool) -> Normalizer {
+        Normalizer {
+            root: root.into(),
+            normalize_unicode,
+        }
+    }
+
+    pub fn normalize(&self, path: impl AsRef<Path>) -> Result<Vec<u8>, NormalizationError> {
+        normalize(path, &self.root, self.normalize_unicode)
+    }
+
+    pub fn denormalize(&self, path: impl Into<Vec<u8>>) -> Result<PathBuf, NormalizationError> {
+        denormalize(path, Some(&self.root))
+    }
+
+    /// Normalizes NUL-separated absolute paths. Returns NUL-separated normalized paths in the same order.
+    pub fn normalize_batch(&self, paths: &str) -> Result<Vec<u8>, NormalizationError> {
+        let mut result = Vec::with_capacity(paths.len());
+        for (i, path) in paths.split('\0').enumerate() {
+            if i > 0 {
+                result.push(0);
+            }
+            result.extend_from_slice(&self.normalize(Path::new(path))?);
+        }
+        Ok(result)
+    }
+
+    fn normalize_cxx(&self, path: &str) -> Result<Vec<u8>, NormalizationError> {
+        self.normalize(Path::new(path))
+    }
+
+    fn denormalize_cxx(&self, path: &[u8]) -> Result<String, NormalizationError> {
+        Ok(String::from(self.denormalize(path)?.to_str().unwrap()))
+    }
+}
+
+fn normalizer_new(root: &str, normalize_unicode: bool) -> Box<Normalizer> {
+    Box::new(Normalizer::new(root, normalize_unicode))
 }
 
 #[cxx::bridge]
 mod ffi {
     extern "Rust" {
-        fn normalize_cxx(path: &str, root: &str, normalize_unicode: bool) -> Result<Vec<u8>>;
-        fn denormalize_cxx(path: &[u8], root: &str) -> Result<String>;
+        type Normalizer;
+
+        fn normalizer_new(root: &str, normalize_unicode: bool) -> Box<Normalizer>;
+        fn normalize_cxx(self: &Normalizer, path: &str) -> Result<Vec<u8>>;
+        fn normalize_batch(self: &Normalizer, paths: &str) -> Result<Vec<u8>>;
+        fn denormalize_cxx(self: &Normalizer, path: &[u8]) -> Result<String>;
     }
 }
 
@@ -136,4 +173,22 @@ mod tests {
             PathBuf::from("/home/123/123.txt")
         );
     }
+
+    #[test]
+    fn test_batch() {
+        let normalizer = Normalizer::new("/home/123", true);
+        assert_eq!(
+            normalizer
+                .normalize_batch("/home/123/a.txt\0/home/123/dir/e\u{301}.txt\0/home/123/dir/")
+                .unwrap(),
+            b"a.txt\0dir/\xc3\xa9.txt\0dir".to_vec()
+        );
+        assert_eq!(
+            normalizer.normalize_batch("/home/123/a.txt").unwrap(),
+            b"a.txt".to_vec()
+        );
+        assert!(normalizer
+            .normalize_batch("/home/123/a.txt\0/home/456/b.txt")
+            .is_err());
+    }
 }